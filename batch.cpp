@@ -0,0 +1,324 @@
+#include "batch.h"
+#include "work_stealing_pool.h"
+#include "stats_json.h"
+#include "verifier.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <set>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <glob.h>
+#include <sys/stat.h>
+#endif
+
+static bool IsPathSeparator(char c) {
+#ifdef _WIN32
+    return c == '/' || c == '\\';
+#else
+    return c == '/';
+#endif
+}
+
+static bool HasVGMExtension(const std::string& name) {
+    size_t dot = name.rfind('.');
+    if (dot == std::string::npos) {
+        return false;
+    }
+    std::string ext = name.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == "vgm" || ext == "vgz";
+}
+
+static std::string JoinPath(const std::string& dir, const std::string& name) {
+    if (dir.empty() || IsPathSeparator(dir[dir.size() - 1])) {
+        return dir + name;
+    }
+    return dir + "/" + name;
+}
+
+// input.vgm -> [outDir/]input.s98
+static std::string MakeOutputPath(const std::string& input, const char* outDir) {
+    size_t slash = input.size();
+    while (slash > 0 && !IsPathSeparator(input[slash - 1])) {
+        slash--;
+    }
+    std::string stem = input.substr(slash);
+    size_t dot = stem.rfind('.');
+    if (dot != std::string::npos && dot > 0) {
+        stem.erase(dot);
+    }
+    
+    std::string dir = outDir ? std::string(outDir) : input.substr(0, slash);
+    return JoinPath(dir, stem + ".s98");
+}
+
+static bool IsDirectory(const char* path) {
+#ifdef _WIN32
+    DWORD attributes = GetFileAttributesA(path);
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+bool CollectBatchJobs(const char* source, const char* outDir, std::vector<BatchJob>& jobs) {
+    std::vector<std::string> inputs;
+    bool isDirectory = IsDirectory(source);
+    
+#ifdef _WIN32
+    // FindFirstFile handles wildcards in the last path component
+    std::string dir = source;
+    std::string pattern = isDirectory ? JoinPath(dir, "*") : dir;
+    if (!isDirectory) {
+        size_t slash = dir.size();
+        while (slash > 0 && !IsPathSeparator(dir[slash - 1])) {
+            slash--;
+        }
+        dir.erase(slash);
+    }
+    
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA(pattern.c_str(), &entry);
+    if (find == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    do {
+        if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+        if (isDirectory && !HasVGMExtension(entry.cFileName)) continue;
+        inputs.push_back(JoinPath(dir, entry.cFileName));
+    } while (FindNextFileA(find, &entry));
+    FindClose(find);
+#else
+    if (isDirectory) {
+        DIR* dir = opendir(source);
+        if (!dir) {
+            return false;
+        }
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            std::string path = JoinPath(source, entry->d_name);
+            if (HasVGMExtension(entry->d_name) && !IsDirectory(path.c_str())) {
+                inputs.push_back(path);
+            }
+        }
+        closedir(dir);
+    } else {
+        glob_t matches;
+        if (glob(source, 0, NULL, &matches) != 0) {
+            return false;
+        }
+        for (size_t i = 0; i < matches.gl_pathc; i++) {
+            if (!IsDirectory(matches.gl_pathv[i])) {
+                inputs.push_back(matches.gl_pathv[i]);
+            }
+        }
+        globfree(&matches);
+    }
+#endif
+    
+    // Stable order regardless of directory enumeration order
+    std::sort(inputs.begin(), inputs.end());
+    for (size_t i = 0; i < inputs.size(); i++) {
+        BatchJob job;
+        job.input = inputs[i];
+        job.output = MakeOutputPath(inputs[i], outDir);
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+bool ReadBatchManifest(const char* path, const char* outDir, std::vector<BatchJob>& jobs) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    
+    char line[4096];
+    while (fgets(line, sizeof(line), f)) {
+        std::string text = line;
+        while (!text.empty() && (text[text.size() - 1] == '\n' || text[text.size() - 1] == '\r')) {
+            text.erase(text.size() - 1);
+        }
+        if (text.empty() || text[0] == '#') {
+            continue;
+        }
+        
+        BatchJob job;
+        size_t tab = text.find('\t');
+        if (tab != std::string::npos) {
+            job.input = text.substr(0, tab);
+            job.output = text.substr(tab + 1);
+        } else {
+            job.input = text;
+            job.output = MakeOutputPath(text, outDir);
+        }
+        jobs.push_back(job);
+    }
+    
+    fclose(f);
+    return true;
+}
+
+bool RunBatch(const std::vector<BatchJob>& jobs, unsigned threads, const ConvertOptions& batchOptions,
+              bool jsonStats, ConversionCache* cache) {
+    WorkStealingPool pool(threads);
+    ConvertOptions options = batchOptions;
+    options.log = NULL; // Workers convert silently
+    
+    // Each worker keeps its own reader/writer pair for all of its files
+    struct WorkerContext {
+        VGMReader reader;
+        S98Writer writer;
+    };
+    std::vector<WorkerContext> contexts(pool.GetThreadCount());
+    
+    // Two inputs mapping to one output (song.vgm and song.vgz) would race on
+    // the same file, so only the first of them is converted
+    std::vector<bool> duplicate(jobs.size(), false);
+    std::set<std::string> outputs;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        duplicate[i] = !outputs.insert(jobs[i].output).second;
+    }
+    
+    std::mutex reportLock;
+    size_t succeeded = 0;
+    size_t failed = 0;
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    
+    fprintf(stderr, "Converting %u files on %u threads...\n", (unsigned)jobs.size(), pool.GetThreadCount());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+    pool.Run(jobs.size(), [&](size_t index, unsigned workerId) {
+        const BatchJob& job = jobs[index];
+        WorkerContext& context = contexts[workerId];
+        std::chrono::steady_clock::time_point fileStart = std::chrono::steady_clock::now();
+        
+        // One bad file must never take the whole batch down
+        ConversionSummary summary;
+        bool ok = false;
+        if (duplicate[index]) {
+            summary.error = "Output path already used by another input: " + job.output;
+        } else {
+            try {
+                if (cache) {
+                    ok = cache->ConvertFile(context.reader, context.writer, job.input.c_str(),
+                                            job.output.c_str(), options, &summary);
+                } else {
+                    ok = ConvertFile(context.reader, context.writer, job.input.c_str(), job.output.c_str(),
+                                     options, &summary);
+                }
+            } catch (const std::exception& e) {
+                summary.error = e.what();
+                context.reader.Close();
+                context.writer.Close();
+            }
+        }
+        
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - fileStart).count();
+        
+        std::lock_guard<std::mutex> guard(reportLock);
+        if (ok) {
+            succeeded++;
+            bytesIn += summary.inputBytes;
+            bytesOut += summary.outputBytes;
+        } else {
+            failed++;
+        }
+        if (jsonStats) {
+            WriteStatsJSON(stdout, job.input.c_str(), job.output.c_str(), ok, summary);
+        } else if (ok && summary.cached) {
+            printf("OK    %s -> %s (cached, %.1f ms)\n", job.input.c_str(), job.output.c_str(), ms);
+        } else if (ok) {
+            printf("OK    %s -> %s (%u writes, %.1f ms)\n", job.input.c_str(), job.output.c_str(),
+                   summary.registerWrites, ms);
+        } else {
+            printf("FAIL  %s: %s\n", job.input.c_str(), summary.error.c_str());
+        }
+        fflush(stdout);
+    });
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (seconds <= 0.0) {
+        seconds = 1e-9;
+    }
+    fprintf(jsonStats ? stderr : stdout,
+            "Batch complete: %u converted, %u failed in %.2f s (%.1f files/s, %.2f MB/s in, %.2f MB/s out)\n",
+           (unsigned)succeeded, (unsigned)failed, seconds, (succeeded + failed) / seconds,
+           bytesIn / seconds / (1024.0 * 1024.0), bytesOut / seconds / (1024.0 * 1024.0));
+    if (cache) {
+        uint64_t lookups = cache->GetHits() + cache->GetMisses();
+        fprintf(jsonStats ? stderr : stdout, "Cache: %llu hits, %llu misses (%.1f%% hit rate)\n",
+                (unsigned long long)cache->GetHits(), (unsigned long long)cache->GetMisses(),
+                lookups ? 100.0 * cache->GetHits() / lookups : 0.0);
+    }
+    return failed == 0;
+}
+
+bool RunBatchVerify(const std::vector<BatchJob>& jobs, unsigned threads, const ConvertOptions& options) {
+    WorkStealingPool pool(threads);
+    
+    struct WorkerContext {
+        VGMReader vgm;
+        S98Reader s98;
+    };
+    std::vector<WorkerContext> contexts(pool.GetThreadCount());
+    
+    std::mutex reportLock;
+    size_t equivalent = 0;
+    size_t failed = 0;
+    uint64_t writes = 0;
+    
+    fprintf(stderr, "Verifying %u files on %u threads...\n", (unsigned)jobs.size(), pool.GetThreadCount());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+    pool.Run(jobs.size(), [&](size_t index, unsigned workerId) {
+        const BatchJob& job = jobs[index];
+        WorkerContext& context = contexts[workerId];
+        std::chrono::steady_clock::time_point fileStart = std::chrono::steady_clock::now();
+        
+        VerifyReport report;
+        bool ok = false;
+        try {
+            ok = VerifyFiles(context.vgm, context.s98, job.input.c_str(), job.output.c_str(), options, &report);
+        } catch (const std::exception& e) {
+            report.error = e.what();
+            context.vgm.Close();
+            context.s98.Close();
+        }
+        
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - fileStart).count();
+        
+        std::lock_guard<std::mutex> guard(reportLock);
+        if (ok) {
+            equivalent++;
+            writes += report.writesMatched;
+            printf("OK    %s == %s (%llu writes, %.1f ms)\n", job.input.c_str(), job.output.c_str(),
+                   (unsigned long long)report.writesMatched, ms);
+        } else {
+            failed++;
+            printf("FAIL  %s: %s\n", job.input.c_str(), report.error.c_str());
+        }
+        fflush(stdout);
+    });
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (seconds <= 0.0) {
+        seconds = 1e-9;
+    }
+    printf("Verify complete: %u equivalent, %u failed in %.2f s (%.1f files/s, %.1f M writes/s)\n",
+           (unsigned)equivalent, (unsigned)failed, seconds, (equivalent + failed) / seconds, writes / seconds / 1e6);
+    return failed == 0;
+}
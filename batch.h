@@ -0,0 +1,37 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+#include <vector>
+#include "converter.h"
+#include "conversion_cache.h"
+
+// One input/output pair of a batch conversion
+struct BatchJob {
+    std::string input;
+    std::string output;
+};
+
+// Collect *.vgm / *.vgz from a directory or from a wildcard pattern.
+// Outputs go to outDir (NULL = next to each input) with a .s98 extension.
+bool CollectBatchJobs(const char* source, const char* outDir, std::vector<BatchJob>& jobs);
+
+// Read a manifest: one input per line, optionally followed by a tab and an
+// explicit output path. Blank lines and lines starting with '#' are ignored.
+bool ReadBatchManifest(const char* path, const char* outDir, std::vector<BatchJob>& jobs);
+
+// Convert all jobs on a work-stealing pool (threads = 0: one per core),
+// printing a result line per file and the overall throughput. Workers run
+// silently regardless of options.log. With jsonStats the per-file lines on
+// stdout are JSON objects (see WriteStatsJSON) and the throughput line goes
+// to stderr. With an open cache, files go through it and the hit rate is
+// reported. Returns false if any file failed.
+bool RunBatch(const std::vector<BatchJob>& jobs, unsigned threads, const ConvertOptions& options,
+              bool jsonStats = false, ConversionCache* cache = NULL);
+
+// Check each job's existing output against its input (see VerifyConversion)
+// on the same pool, printing a result line per file. Returns false if any
+// file differs or could not be read.
+bool RunBatchVerify(const std::vector<BatchJob>& jobs, unsigned threads, const ConvertOptions& options);
+
+#endif // BATCH_H
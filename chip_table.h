@@ -0,0 +1,54 @@
+#ifndef CHIP_TABLE_H
+#define CHIP_TABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "s98_writer.h"
+
+// Everything the converter knows about a chip, in one row: the VGM write
+// opcode of its first instance (port 1, if any, is the next opcode), where
+// its clock sits in the VGM header and the S98 device it becomes. Header
+// chips are added to the S98 in table order, so rows must only ever be
+// appended to keep existing output unchanged.
+struct VGMChipDescriptor {
+    const char* name;
+    uint8_t command;      // Port 0 write opcode of the first chip
+    uint8_t ports;        // 1 or 2 consecutive opcodes
+    uint8_t clockOffset;  // Header clock field (bit 30: second chip)
+    S98DeviceType s98Type;
+    uint32_t defaultClock; // Used when the header gives none (0 = writes are dropped)
+};
+
+static constexpr VGMChipDescriptor kVGMChips[] = {
+    { "YM2608 (OPNA)", 0x56, 2, 0x48, S98_DEV_OPNA, 8000000 }, // PC-98 default
+    { "YM2610 (OPNB)", 0x58, 2, 0x4C, S98_DEV_OPNA, 0 },
+    { "YM2612 (OPN2)", 0x52, 2, 0x2C, S98_DEV_OPN2, 0 },
+    { "YM2203 (OPN)",  0x55, 1, 0x44, S98_DEV_OPN,  0 },
+    { "YM2151 (OPM)",  0x54, 1, 0x30, S98_DEV_OPM,  0 },
+    { "YM2413 (OPLL)", 0x51, 1, 0x10, S98_DEV_OPLL, 0 },
+    { "YM3812 (OPL)",  0x5A, 1, 0x50, S98_DEV_OPL,  0 },
+    { "YM3526 (OPL2)", 0x5B, 1, 0x54, S98_DEV_OPL2, 0 },
+    { "AY8910",        0xA0, 1, 0x74, S98_DEV_AY8910, 0 }, // Register bit 7 selects the second chip
+    { "SN76489",       0x50, 1, 0x0C, S98_DEV_SN76489, 0 },
+};
+
+static constexpr size_t kVGMChipCount = sizeof(kVGMChips) / sizeof(kVGMChips[0]);
+static constexpr uint8_t kVGMChipNone = 0xFF;
+
+// Row of the chip a first-chip write opcode addresses, or kVGMChipNone.
+// Meant for compile-time tables; the decoder hands out the row with every
+// command (VGMCommand::chip).
+static constexpr uint8_t FindVGMChip(unsigned cmd, size_t row = 0) {
+    return row >= kVGMChipCount ? kVGMChipNone :
+           cmd >= kVGMChips[row].command && cmd < (unsigned)kVGMChips[row].command + kVGMChips[row].ports ?
+           (uint8_t)row : FindVGMChip(cmd, row + 1);
+}
+
+// Bit in VGMHeader::dualChips for a row
+static constexpr uint32_t VGMDualFlag(uint8_t chip) { return 1u << chip; }
+
+static_assert(kVGMChipCount <= 32, "VGMHeader::dualChips holds one bit per chip");
+static_assert(FindVGMChip(0x53) == FindVGMChip(0x52) && FindVGMChip(0x5E) == kVGMChipNone,
+              "VGM chip table");
+
+#endif // CHIP_TABLE_H
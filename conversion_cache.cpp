@@ -0,0 +1,222 @@
+#include "conversion_cache.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const uint64_t kHashMultiplier = 0x9E3779B97F4A7C15ULL;
+
+// splitmix64 finalizer: every input bit reaches every output bit
+static uint64_t Mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+uint64_t HashBytes(const uint8_t* data, size_t size, uint64_t seed) {
+    uint64_t h = seed ^ ((uint64_t)size * kHashMultiplier);
+    while (size >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        h = (h ^ Mix(word)) * kHashMultiplier;
+        data += 8;
+        size -= 8;
+    }
+    if (size > 0) {
+        uint64_t word = 0;
+        memcpy(&word, data, size);
+        h = (h ^ Mix(word)) * kHashMultiplier;
+    }
+    return Mix(h);
+}
+
+// Only the options that change the bytes written; the pipeline and stage
+// profiling do not
+static uint64_t HashOptions(const ConvertOptions& options) {
+    char text[160];
+    snprintf(text, sizeof(text), "vgm2s98 output %d coalesce=%d optimize=%d verify=%d dac=%d timer=%u%s",
+             VGM2S98_OUTPUT_VERSION, (int)options.coalesceWaits, (int)options.optimizeRegisters,
+             (int)options.verifyLoop, (int)options.expandDAC, options.timerRate,
+             options.detectLoop ? " detect-loop" : "");
+    return HashBytes((const uint8_t*)text, strlen(text));
+}
+
+static bool IsDirectory(const char* path) {
+#ifdef _WIN32
+    DWORD attributes = GetFileAttributesA(path);
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+static bool MakeDirectory(const char* path) {
+#ifdef _WIN32
+    return _mkdir(path) == 0 || IsDirectory(path);
+#else
+    return mkdir(path, 0777) == 0 || IsDirectory(path);
+#endif
+}
+
+static bool MakeHardLink(const char* existing, const char* path) {
+#ifdef _WIN32
+    return CreateHardLinkA(path, existing, NULL) != 0;
+#else
+    return link(existing, path) == 0;
+#endif
+}
+
+static unsigned GetProcessId() {
+#ifdef _WIN32
+    return (unsigned)_getpid();
+#else
+    return (unsigned)getpid();
+#endif
+}
+
+static bool CopyFileContents(const char* source, const char* dest) {
+    FILE* in = fopen(source, "rb");
+    if (!in) {
+        return false;
+    }
+    FILE* out = fopen(dest, "wb");
+    if (!out) {
+        fclose(in);
+        return false;
+    }
+    
+    std::vector<uint8_t> chunk(64 * 1024);
+    bool ok = true;
+    size_t n;
+    while ((n = fread(chunk.data(), 1, chunk.size(), in)) > 0) {
+        if (fwrite(chunk.data(), 1, n, out) != n) {
+            ok = false;
+            break;
+        }
+    }
+    ok = ok && !ferror(in);
+    fclose(in);
+    if (fclose(out) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        remove(dest);
+    }
+    return ok;
+}
+
+static long GetFileSize(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return -1;
+    }
+    long size = -1;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        size = ftell(f);
+    }
+    fclose(f);
+    return size;
+}
+
+ConversionCache::ConversionCache() : hits(0), misses(0), tempCounter(0) {
+}
+
+bool ConversionCache::Open(const char* dir) {
+    if (!MakeDirectory(dir)) {
+        return false;
+    }
+    directory = dir;
+    return true;
+}
+
+std::string ConversionCache::GetEntryPath(uint64_t key) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.s98", (unsigned long long)key);
+    char last = directory[directory.size() - 1];
+    if (last == '/' || last == '\\') {
+        return directory + name;
+    }
+    return directory + "/" + name;
+}
+
+// Copy a fresh output into the cache. The copy is written under a private
+// name and renamed into place, so readers never see a partial entry; if
+// another worker stored the same key first, its entry is kept.
+bool ConversionCache::Store(const char* outputFile, const std::string& entry) {
+    char suffix[48];
+    snprintf(suffix, sizeof(suffix), ".tmp%u.%u", GetProcessId(), (unsigned)tempCounter++);
+    std::string temp = entry + suffix;
+    if (!CopyFileContents(outputFile, temp.c_str())) {
+        return false;
+    }
+    if (rename(temp.c_str(), entry.c_str()) != 0) {
+        remove(temp.c_str()); // Windows will not rename over an existing entry
+    }
+    return true;
+}
+
+bool ConversionCache::ConvertFile(VGMReader& reader, S98Writer& writer, const char* inputFile,
+                                  const char* outputFile, const ConvertOptions& options,
+                                  ConversionSummary* summary) {
+    // The cache holds the S98 only, not its seek index
+    if (options.seekIndexSeconds > 0) {
+        return ::ConvertFile(reader, writer, inputFile, outputFile, options, summary);
+    }
+    
+    ConversionSummary local;
+    if (!summary) summary = &local;
+    
+    // Hash the input as stored, through the same mapping the conversion uses
+    if (!reader.Open(inputFile)) {
+        summary->error = "Could not open input file";
+        return false;
+    }
+    uint64_t key = HashBytes(reader.GetInputData(), reader.GetInputSize(), HashOptions(options));
+    uint32_t inputBytes = reader.GetInputSize();
+    reader.Close();
+    std::string entry = GetEntryPath(key);
+    
+    // The old output may itself be a link to an entry: replace, never rewrite
+    remove(outputFile);
+    
+    long cachedSize = GetFileSize(entry.c_str());
+    if (cachedSize >= 0 && (MakeHardLink(entry.c_str(), outputFile) ||
+                            CopyFileContents(entry.c_str(), outputFile))) {
+        hits++;
+        summary->cached = true;
+        summary->inputBytes = inputBytes;
+        summary->outputBytes = (uint32_t)cachedSize;
+        if (options.log) {
+            fprintf(options.log, "Cache hit: %s\n", entry.c_str());
+        }
+        return true;
+    }
+    
+    misses++;
+    if (!::ConvertFile(reader, writer, inputFile, outputFile, options, summary)) {
+        return false;
+    }
+    if (!Store(outputFile, entry)) {
+        if (options.log) {
+            fprintf(options.log, "Warning: Could not store %s in the cache\n", outputFile);
+        }
+    } else if (options.log) {
+        fprintf(options.log, "Cache miss, stored as %s\n", entry.c_str());
+    }
+    return true;
+}
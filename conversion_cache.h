@@ -0,0 +1,44 @@
+#ifndef CONVERSION_CACHE_H
+#define CONVERSION_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <string>
+#include "converter.h"
+
+// 64-bit non-cryptographic hash, one multiply per 8 input bytes
+uint64_t HashBytes(const uint8_t* data, size_t size, uint64_t seed = 0);
+
+// On-disk cache of converted files for incremental rebuilds. An entry is a
+// plain S98 file named <key>.s98, where the key hashes the input bytes as
+// stored, the options that change the output and VGM2S98_OUTPUT_VERSION.
+// Entries appear through an atomic rename and are never modified, so one
+// cache can be shared by batch workers and by concurrent runs.
+class ConversionCache {
+public:
+    ConversionCache();
+    
+    bool Open(const char* directory); // Creates the directory if needed
+    bool IsOpen() const { return !directory.empty(); }
+    
+    // ConvertFile through the cache. A hit hardlinks the stored S98 to
+    // outputFile (copying where links are not possible) and sets
+    // summary->cached; a miss converts as usual and stores the result.
+    bool ConvertFile(VGMReader& reader, S98Writer& writer, const char* inputFile, const char* outputFile,
+                     const ConvertOptions& options, ConversionSummary* summary = NULL);
+    
+    uint64_t GetHits() const { return hits.load(); }
+    uint64_t GetMisses() const { return misses.load(); }
+    
+private:
+    std::string directory;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint32_t> tempCounter; // Unique temporary names per process
+    
+    std::string GetEntryPath(uint64_t key) const;
+    bool Store(const char* outputFile, const std::string& entry);
+};
+
+#endif // CONVERSION_CACHE_H
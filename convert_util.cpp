@@ -0,0 +1,19 @@
+#include "convert_util.h"
+#include <stdarg.h>
+
+void LogMessage(FILE* log, const char* format, ...) {
+    if (!log) return;
+    va_list args;
+    va_start(args, format);
+    vfprintf(log, format, args);
+    va_end(args);
+}
+
+uint64_t Gcd(uint64_t a, uint64_t b) {
+    while (b != 0) {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
@@ -0,0 +1,15 @@
+#ifndef CONVERT_UTIL_H
+#define CONVERT_UTIL_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Helpers shared by the VGM to S98 and S98 to VGM converters; not part of
+// the library's interface.
+
+// printf to the conversion log, if there is one
+void LogMessage(FILE* log, const char* format, ...);
+
+uint64_t Gcd(uint64_t a, uint64_t b);
+
+#endif // CONVERT_UTIL_H
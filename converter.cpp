@@ -0,0 +1,1169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <system_error>
+#include <thread>
+#include "converter.h"
+#include "convert_util.h"
+#include "wait_coalescer.h"
+#include "register_shadow.h"
+#include "spsc_ring.h"
+#include "dac_expander.h"
+#include "loop_detector.h"
+#include "seek_index.h"
+
+// Row of the YM2612, which DAC expansion writes to
+static constexpr uint8_t kYM2612 = FindVGMChip(VGM_CMD_YM2612_PORT0);
+
+// Map VGM chip commands to S98 device types
+S98DeviceType GetS98DeviceType(uint8_t vgmCmd) {
+    uint8_t chip = FindVGMChip(vgmCmd);
+    return chip != kVGMChipNone ? kVGMChips[chip].s98Type : S98_DEV_NONE;
+}
+
+uint32_t GetVGMClock(uint8_t vgmCmd, const VGMHeader& header) {
+    uint8_t chip = FindVGMChip(vgmCmd);
+    return chip != kVGMChipNone ? header.clocks[chip] : 0;
+}
+
+void GetS98Instances(const VGMHeader& header, uint8_t firstInstance[kVGMChipCount]) {
+    // Header chips in table order, then the chips only a default clock
+    // brings in (added when first written, after all header devices)
+    uint8_t count[256] = {};
+    for (uint8_t pass = 0; pass < 2; pass++) {
+        for (uint8_t chip = 0; chip < kVGMChipCount; chip++) {
+            if ((header.clocks[chip] != 0) != (pass == 0)) continue;
+            uint8_t& next = count[kVGMChips[chip].s98Type];
+            firstInstance[chip] = next;
+            next += (header.dualChips & VGMDualFlag(chip)) || header.clocks[chip] == 0 ? 2 : 1;
+        }
+    }
+}
+
+// One GD3 code unit (UTF-16LE)
+static inline uint32_t ReadUTF16LE(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+// Decode one NUL-terminated UTF-16LE GD3 string at data into UTF-8 in out,
+// folding fullwidth ASCII and currency forms to their normal counterparts.
+// scratch must hold 3 bytes per code unit of size. Returns the bytes
+// consumed, terminator included.
+static size_t DecodeGD3String(const uint8_t* data, size_t size, std::vector<char>& scratch, std::string& out) {
+    // Code unit masks as they lie in memory, so the tests below hold on
+    // either byte order: a unit is ASCII when its high byte is 0 and its
+    // low byte is below 0x80
+    static const uint8_t kNonASCIIBytes[8] = { 0x80, 0xFF, 0x80, 0xFF, 0x80, 0xFF, 0x80, 0xFF };
+    static const uint8_t kHighBytes[8] = { 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF };
+    uint64_t nonASCII;
+    uint64_t highBytes;
+    memcpy(&nonASCII, kNonASCIIBytes, 8);
+    memcpy(&highBytes, kHighBytes, 8);
+    
+    size_t units = size / 2;
+    char* dest = scratch.data();
+    size_t n = 0;
+    size_t i = 0;
+    
+    // Skip BOM if present (0xFFFE for UTF-16LE, 0xFEFF for UTF-16BE)
+    if (units > 0 && (ReadUTF16LE(data) == 0xFFFE || ReadUTF16LE(data) == 0xFEFF)) {
+        i = 1;
+    }
+    
+    while (i < units) {
+        // ASCII fast path: four code units per 64-bit load, copied as they
+        // are until a unit is 0 or at least 0x80
+        while (i + 4 <= units) {
+            uint64_t word;
+            memcpy(&word, data + i * 2, 8);
+            if (word & nonASCII) break;
+            uint64_t low = word | highBytes; // Only a zero low byte can be a zero byte now
+            if ((low - 0x0101010101010101ULL) & ~low & 0x8080808080808080ULL) break;
+            const uint8_t* p = data + i * 2;
+            dest[n] = (char)p[0];
+            dest[n + 1] = (char)p[2];
+            dest[n + 2] = (char)p[4];
+            dest[n + 3] = (char)p[6];
+            n += 4;
+            i += 4;
+        }
+        if (i >= units) break;
+        
+        uint32_t codePoint = ReadUTF16LE(data + i * 2);
+        i++;
+        if (codePoint == 0) {
+            out.assign(dest, n);
+            return i * 2;
+        }
+        
+        // Handle surrogate pairs FIRST (before any other processing)
+        if (codePoint >= 0xD800 && codePoint <= 0xDBFF && i < units) {
+            uint32_t low = ReadUTF16LE(data + i * 2);
+            if (low >= 0xDC00 && low <= 0xDFFF) {
+                codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                i++; // Skip the low surrogate
+            }
+        }
+        
+        // Convert fullwidth characters to ASCII equivalents (only for BMP characters)
+        if (codePoint < 0x10000) {
+            if (codePoint >= 0xFF01 && codePoint <= 0xFF5E) {
+                // Fullwidth ASCII variants -> normal ASCII (0xFF01-0xFF5E -> 0x0021-0x007E)
+                codePoint = codePoint - 0xFF00;
+            } else if (codePoint >= 0xFFE0 && codePoint <= 0xFFE6) {
+                // Fullwidth currency symbols -> ASCII equivalents
+                if (codePoint == 0xFFE5) codePoint = 0x00A5; // Fullwidth yen -> yen sign
+                else if (codePoint == 0xFFE0) codePoint = 0x00A2; // Fullwidth cent -> cent sign
+                else if (codePoint == 0xFFE1) codePoint = 0x00A3; // Fullwidth pound -> pound sign
+                else if (codePoint == 0xFFE6) codePoint = 0x20A9; // Fullwidth won -> won sign
+            }
+        }
+        
+        // Convert code point to UTF-8 (a surrogate pair is 2 units for 4 bytes)
+        if (codePoint < 0x80) {
+            dest[n++] = (char)codePoint;
+        } else if (codePoint < 0x800) {
+            dest[n++] = (char)(0xC0 | (codePoint >> 6));
+            dest[n++] = (char)(0x80 | (codePoint & 0x3F));
+        } else if (codePoint < 0x10000) {
+            dest[n++] = (char)(0xE0 | (codePoint >> 12));
+            dest[n++] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+            dest[n++] = (char)(0x80 | (codePoint & 0x3F));
+        } else {
+            dest[n++] = (char)(0xF0 | (codePoint >> 18));
+            dest[n++] = (char)(0x80 | ((codePoint >> 12) & 0x3F));
+            dest[n++] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+            dest[n++] = (char)(0x80 | (codePoint & 0x3F));
+        }
+    }
+    
+    // Unterminated: the string runs to the end of the block
+    out.assign(dest, n);
+    return size;
+}
+
+// Extract GD3 tag metadata from the bytes the reader already holds
+bool ExtractGD3Tags(VGMReader& reader, const VGMHeader& header, std::map<std::string, std::string>& tags) {
+    if (header.gd3Offset == 0) {
+        return false;
+    }
+    
+    // GD3 offset is relative to 0x14
+    uint32_t gd3Pos = header.gd3Offset + 0x14;
+    
+    // Check GD3 magic, then read version and length
+    uint8_t gd3Header[12];
+    if (!reader.ReadBytes(gd3Pos, sizeof(gd3Header), gd3Header) || memcmp(gd3Header, "Gd3 ", 4) != 0) {
+        return false;
+    }
+    uint32_t length = (uint32_t)gd3Header[8] | ((uint32_t)gd3Header[9] << 8) |
+                      ((uint32_t)gd3Header[10] << 16) | ((uint32_t)gd3Header[11] << 24);
+    if (length == 0) {
+        return true; // A tag block with no strings
+    }
+    
+    // Raw input is decoded in place; only .vgz needs a copy
+    std::vector<uint8_t> copy;
+    const uint8_t* gd3Data = reader.GetBytes(gd3Pos + sizeof(gd3Header), length, copy);
+    if (!gd3Data) {
+        return false;
+    }
+    size_t gd3Cursor = 0;
+    
+    // Read UTF-16 strings (title, game, system, composer, release date, notes)
+    // Each string is UTF-16LE, null-terminated
+    std::vector<char> scratch((size_t)length / 2 * 3 + 1);
+    auto ReadUTF16String = [&]() -> std::string {
+        std::string result;
+        gd3Cursor += DecodeGD3String(gd3Data + gd3Cursor, length - gd3Cursor, scratch, result);
+        return result;
+    };
+    
+    // GD3 format has 11 strings:
+    // 1. Track Name (EN)
+    // 2. Track Name (JP)
+    // 3. Game Name (EN)
+    // 4. Game Name (JP)
+    // 5. System Name (EN)
+    // 6. System Name (JP)
+    // 7. Artist (EN)
+    // 8. Artist (JP)
+    // 9. Release Date
+    // 10. VGM Creator
+    // 11. Notes
+    
+    std::string titleEN = ReadUTF16String();
+    std::string titleJP = ReadUTF16String();
+    std::string gameEN = ReadUTF16String();
+    std::string gameJP = ReadUTF16String();
+    std::string systemEN = ReadUTF16String();
+    std::string systemJP = ReadUTF16String();
+    std::string artistEN = ReadUTF16String();
+    std::string artistJP = ReadUTF16String();
+    std::string releaseDate = ReadUTF16String();
+    std::string vgmCreator = ReadUTF16String();
+    std::string notes = ReadUTF16String();
+    
+    // Use English version if available, otherwise Japanese
+    std::string title = !titleEN.empty() ? titleEN : titleJP;
+    std::string game = !gameEN.empty() ? gameEN : gameJP;
+    std::string system = !systemEN.empty() ? systemEN : systemJP;
+    std::string composer = !artistEN.empty() ? artistEN : artistJP;
+    
+    if (!title.empty()) tags["title"] = title;
+    if (!game.empty()) tags["game"] = game;
+    if (!system.empty()) tags["system"] = system;
+    if (!composer.empty()) tags["artist"] = composer;
+    if (!releaseDate.empty()) tags["year"] = releaseDate;
+    if (!vgmCreator.empty()) tags["s98by"] = vgmCreator;
+    if (!notes.empty()) tags["comment"] = notes;
+    
+    return true;
+}
+
+// Validate the VGM header and report what it declares
+static bool ReadInputHeader(VGMReader& reader, VGMHeader& vgmHeader, const ConvertOptions& options,
+                            ConversionSummary* summary) {
+    FILE* log = options.log;
+    if (!reader.ReadHeader(vgmHeader)) {
+        if (summary) summary->error = "Invalid VGM file";
+        return false;
+    }
+    
+    LogMessage(log, "VGM Version: %d.%02d\n", (vgmHeader.version >> 8) & 0xFF, vgmHeader.version & 0xFF);
+    LogMessage(log, "Total samples: %u\n", vgmHeader.totalSamples);
+    LogMessage(log, "Loop samples: %u\n", vgmHeader.loopSamples);
+    if (vgmHeader.volumeModifier != 0) {
+        // Volume = 2 ^ (volumeModifier / 32.0)
+        double gainFactor = pow(2.0, vgmHeader.volumeModifier / 32.0);
+        LogMessage(log, "Volume modifier: %d (gain factor: %.4f)\n",
+                (int)vgmHeader.volumeModifier, gainFactor);
+    }
+    
+    return true;
+}
+
+// Add the devices the header clocks declare, in table order; dual chips
+// get two instances
+static void AddHeaderDevices(S98Writer& writer, FILE* log, const VGMHeader& header) {
+    uint8_t firstInstance[kVGMChipCount];
+    GetS98Instances(header, firstInstance);
+    for (uint8_t chip = 0; chip < kVGMChipCount; chip++) {
+        const VGMChipDescriptor& desc = kVGMChips[chip];
+        uint32_t clock = header.clocks[chip];
+        if (clock == 0) continue;
+        writer.AddDevice(desc.s98Type, clock, 0, firstInstance[chip]);
+        LogMessage(log, "Added %s device, clock: %u Hz\n", desc.name, clock);
+        if (header.dualChips & VGMDualFlag(chip)) {
+            writer.AddDevice(desc.s98Type, clock, 0, firstInstance[chip] + 1);
+            LogMessage(log, "Added second %s device, clock: %u Hz\n", desc.name, clock);
+        }
+    }
+}
+
+// Turns decoded VGM commands into S98 output: device mapping, wait
+// coalescing, register optimization and loop placement. Fed one command at
+// a time, either straight from the reader or from the pipeline ring.
+class CommandEncoder {
+public:
+    CommandEncoder(S98Writer& writer, const VGMHeader& vgmHeader, const ConvertOptions& options,
+                   uint32_t loopOffset, uint32_t endOffset = 0)
+        : writer(writer), vgmHeader(vgmHeader), options(options), log(options.log),
+          loopOffset(loopOffset), endOffset(endOffset), waits(writer, options.coalesceWaits),
+          totalSamples(0), loopStartSamples(0), atLoopPoint(false),
+          regWriteCount(0), waitCount(0), unknownCount(0), dacWriteCount(0),
+          skippedBlocks(0), skippedBlockBytes(0), opcodeCounts(256, 0) {
+        GetS98Instances(vgmHeader, firstInstance);
+        memset(deviceIds, 0xFF, sizeof(deviceIds));
+    }
+    
+    // Returns false once the end command has been written
+    bool Handle(const VGMCommand& cmd);
+    
+    // Data that ends without an end command still keeps its trailing wait
+    void Finish() { waits.Flush(); }
+    
+    S98Writer& writer;
+    const VGMHeader& vgmHeader;
+    const ConvertOptions& options;
+    FILE* log;
+    uint32_t loopOffset;
+    uint32_t endOffset; // Data from here on repeats the loop and is left out (0 = none)
+    
+    // Waits are merged until something else has to be written
+    WaitCoalescer waits;
+    
+    // Register state as written so far, for dropping redundant writes
+    RegisterShadow shadow;
+    
+    // PCM bank and stream state for options.expandDAC
+    DACExpander dac;
+    
+    uint32_t totalSamples;
+    uint32_t loopStartSamples;
+    bool atLoopPoint;
+    uint32_t regWriteCount;
+    uint32_t waitCount;
+    uint32_t unknownCount;
+    uint32_t dacWriteCount;
+    uint32_t skippedBlocks;
+    uint32_t skippedBlockBytes;
+    std::vector<uint32_t> opcodeCounts; // By opcode byte
+    std::vector<uint32_t> deviceWrites; // By S98 device entry (device ID / 2)
+    
+private:
+    // Base S98 device ID by chip row and instance, 0xFF until first used
+    uint8_t deviceIds[kVGMChipCount][2];
+    uint8_t firstInstance[kVGMChipCount]; // S98 instance of each chip's first instance
+    
+    uint8_t AddChipDevice(uint8_t chip, uint8_t instance);
+    void WriteChip(uint8_t chip, uint8_t instance, uint8_t port, uint8_t reg, uint8_t data);
+    void Wait(uint32_t samples);
+    void WriteDueStreamData();
+};
+
+// Look up a chip's S98 device on its first write, adding it if the header
+// did not declare it. Returns 0xFF if the chip has no clock to run at.
+uint8_t CommandEncoder::AddChipDevice(uint8_t chip, uint8_t instance) {
+    const VGMChipDescriptor& desc = kVGMChips[chip];
+    uint8_t s98Instance = (uint8_t)(firstInstance[chip] + instance);
+    uint8_t deviceId = writer.GetDeviceId(desc.s98Type, s98Instance);
+    if (deviceId == 0xFF) {
+        uint32_t clock = vgmHeader.clocks[chip] != 0 ? vgmHeader.clocks[chip] : desc.defaultClock;
+        if (clock == 0) {
+            return 0xFF; // Skip if no clock info
+        }
+        writer.AddDevice(desc.s98Type, clock, 0, s98Instance);
+        deviceId = writer.GetDeviceId(desc.s98Type, s98Instance);
+    }
+    deviceIds[chip][instance] = deviceId;
+    return deviceId;
+}
+
+// Map a chip write to its S98 device (adding the device on first use) and
+// write it, unless the optimizer finds it redundant
+void CommandEncoder::WriteChip(uint8_t chip, uint8_t instance, uint8_t port, uint8_t reg, uint8_t data) {
+    uint8_t deviceId = deviceIds[chip][instance & 1];
+    if (deviceId == 0xFF && (deviceId = AddChipDevice(chip, instance & 1)) == 0xFF) {
+        return;
+    }
+    
+    // S98 format: device ID is base (even) + port (0 or 1)
+    uint8_t s98DeviceId = deviceId + port;
+    
+    if (options.optimizeRegisters && !shadow.Write(kVGMChips[chip].s98Type, s98DeviceId, reg, data)) {
+        return; // Cannot change chip state
+    }
+    
+    waits.Flush();
+    writer.WriteRegister(s98DeviceId, reg, data);
+    regWriteCount++;
+    
+    size_t entry = deviceId / 2;
+    if (entry >= deviceWrites.size()) {
+        deviceWrites.resize(entry + 1, 0);
+    }
+    deviceWrites[entry]++;
+}
+
+// Queue a wait, splitting it wherever a DAC stream write falls inside
+void CommandEncoder::Wait(uint32_t samples) {
+    if (dac.HasActiveStreams()) {
+        uint64_t end = (uint64_t)totalSamples + samples;
+        WriteDueStreamData();
+        while (dac.HasActiveStreams()) {
+            uint64_t next = dac.NextWriteTime();
+            if (next >= end) break;
+            waits.AddWait((uint32_t)(next - totalSamples));
+            totalSamples = (uint32_t)next;
+            WriteDueStreamData();
+        }
+        samples = (uint32_t)(end - totalSamples);
+    }
+    waits.AddWait(samples);
+    totalSamples += samples;
+}
+
+void CommandEncoder::WriteDueStreamData() {
+    DACWrite write;
+    while (dac.PopDueWrite(totalSamples, write)) {
+        WriteChip(kYM2612, write.instance, write.cmd & 1, write.reg, write.data);
+        dacWriteCount++;
+    }
+}
+
+bool CommandEncoder::Handle(const VGMCommand& cmd) {
+    opcodeCounts[cmd.opcode]++;
+    
+    if (!atLoopPoint && loopOffset > 0 && cmd.offset >= loopOffset) {
+        if (cmd.offset != loopOffset) {
+            // Loop offset points inside a command: use the next boundary
+            LogMessage(log, "Warning: Loop offset 0x%X is not a command boundary, using 0x%X\n",
+                    loopOffset, cmd.offset);
+        }
+        // The loop must start after exactly the waits seen so far
+        waits.Flush();
+        writer.SetLoopPoint();
+        shadow.Invalidate(); // Looping arrives with end-of-song state
+        atLoopPoint = true;
+        loopStartSamples = totalSamples;
+        LogMessage(log, "Loop point set at offset 0x%X (%u samples)\n", cmd.offset, totalSamples);
+    }
+    
+    if (cmd.cmd == VGM_CMD_END || (endOffset > 0 && cmd.offset >= endOffset)) {
+        waits.Flush();
+        writer.WriteEnd();
+        return false;
+    }
+    
+    // 0x8n writes the next PCM bank byte to the YM2612 DAC before its wait
+    uint8_t sample;
+    if (cmd.kind == VGM_KIND_DAC_WAIT && options.expandDAC && dac.NextDirectSample(sample)) {
+        WriteChip(kYM2612, 0, 0, 0x2A, sample);
+        dacWriteCount++;
+    }
+    
+    if (cmd.waitSamples > 0) {
+        waitCount++;
+        // Queue wait command
+        Wait(cmd.waitSamples);
+    }
+    
+    // The decoder already named the chip of every write it knows
+    if (cmd.chip != kVGMChipNone) {
+        WriteChip(cmd.chip, cmd.instance, cmd.port, cmd.reg, cmd.data);
+    } else if (cmd.cmd == VGM_CMD_DATA_BLOCK) {
+        if (options.expandDAC && cmd.blockType == 0x00) {
+            dac.AddDataBlock((uint8_t)cmd.blockType, cmd.blockData, cmd.blockSize);
+            LogMessage(log, "Loaded YM2612 PCM data block (%u bytes)\n", cmd.blockSize);
+        } else {
+            // Data blocks are not directly supported in S98
+            LogMessage(log, "Skipping data block type 0x%02X\n", cmd.blockType);
+            skippedBlocks++;
+            skippedBlockBytes += cmd.blockSize;
+        }
+    } else if (cmd.cmd == VGM_CMD_PCM_SEEK) {
+        if (options.expandDAC) {
+            dac.Seek(cmd.pcmOffset);
+        } else {
+            // PCM seek - not directly supported in S98
+            LogMessage(log, "Skipping PCM seek to offset 0x%X\n", cmd.pcmOffset);
+        }
+    } else if (cmd.kind == VGM_KIND_STREAM && options.expandDAC) {
+        dac.StreamCommand(cmd.cmd, cmd.operands, totalSamples);
+        WriteDueStreamData(); // A stream's first write is due at its start
+    } else if (cmd.kind != VGM_KIND_WAIT && cmd.kind != VGM_KIND_DAC_WAIT) {
+        // Command with no S98 equivalent (without DAC expansion the DAC
+        // write of 0x8n is dropped; its wait was queued above)
+        unknownCount++;
+        if (unknownCount <= 10) {
+            LogMessage(log, "Debug: Unhandled command 0x%02X (reg=%u, data=%u)\n", 
+                    cmd.cmd, cmd.reg, cmd.data);
+        }
+    }
+    return true;
+}
+
+// Compact fixed-size form of a VGMCommand for the pipeline ring. Block
+// payloads do not cross the ring; the encoder only needs their header.
+struct PipelineEvent {
+    uint32_t offset;
+    uint32_t value; // waitSamples, blockSize or pcmOffset, depending on kind
+    uint8_t cmd;
+    uint8_t kind;
+    uint8_t instance;
+    uint8_t port;
+    uint8_t reg;
+    uint8_t data;
+    uint8_t blockType;
+    uint8_t opcode;
+    uint8_t chip;
+};
+
+static void PackEvent(const VGMCommand& cmd, PipelineEvent& event) {
+    event.offset = cmd.offset;
+    event.value = cmd.kind == VGM_KIND_DATA_BLOCK ? cmd.blockSize :
+                  cmd.kind == VGM_KIND_PCM_SEEK ? cmd.pcmOffset : cmd.waitSamples;
+    event.cmd = cmd.cmd;
+    event.kind = cmd.kind;
+    event.instance = cmd.instance;
+    event.port = cmd.port;
+    event.reg = cmd.reg;
+    event.data = cmd.data;
+    event.blockType = (uint8_t)cmd.blockType;
+    event.opcode = cmd.opcode;
+    event.chip = cmd.chip;
+}
+
+static void UnpackEvent(const PipelineEvent& event, VGMCommand& cmd) {
+    cmd = VGMCommand();
+    cmd.offset = event.offset;
+    cmd.opcode = event.opcode;
+    cmd.cmd = event.cmd;
+    cmd.kind = event.kind;
+    cmd.instance = event.instance;
+    cmd.port = event.port;
+    cmd.reg = event.reg;
+    cmd.data = event.data;
+    cmd.chip = event.chip;
+    if (event.kind == VGM_KIND_DATA_BLOCK) {
+        cmd.blockType = event.blockType;
+        cmd.blockSize = event.value;
+    } else if (event.kind == VGM_KIND_PCM_SEEK) {
+        cmd.pcmOffset = event.value;
+    } else {
+        cmd.waitSamples = event.value;
+    }
+}
+
+// Events in flight between the decode and encode threads
+static const size_t kPipelineCapacity = 4096;
+
+typedef std::chrono::steady_clock StageClock;
+
+static double Seconds(StageClock::duration duration) {
+    return std::chrono::duration<double>(duration).count();
+}
+
+// Decode on a second thread while this one encodes. Each side yields while
+// the ring is full (decoder) or empty (encoder); every such wait counts as
+// one stall. Stage times are each thread's wall time, stalls included.
+// Returns false if the decode thread could not be started.
+static bool RunPipeline(VGMReader& reader, CommandEncoder& encoder,
+                        uint64_t& decodeStalls, uint64_t& encodeStalls,
+                        double& decodeSeconds, double& encodeSeconds) {
+    SpscRing<PipelineEvent> ring(kPipelineCapacity);
+    std::atomic<bool> decodeDone(false);
+    std::atomic<bool> cancel(false);
+    decodeStalls = 0;
+    encodeStalls = 0;
+    
+    std::thread decoder;
+    try {
+        decoder = std::thread([&]() {
+            StageClock::time_point start = StageClock::now();
+            VGMCommand cmd;
+            PipelineEvent event;
+            while (!cancel.load(std::memory_order_relaxed) && reader.ReadNextCommand(cmd)) {
+                PackEvent(cmd, event);
+                if (!ring.TryPush(event)) {
+                    decodeStalls++;
+                    ring.Flush();
+                    do {
+                        std::this_thread::yield();
+                        if (cancel.load(std::memory_order_relaxed)) return;
+                    } while (!ring.TryPush(event));
+                }
+                if (cmd.cmd == VGM_CMD_END) break;
+            }
+            ring.Flush();
+            decodeSeconds = Seconds(StageClock::now() - start);
+            decodeDone.store(true, std::memory_order_release);
+        });
+    } catch (const std::system_error&) {
+        return false;
+    }
+    
+    // The decode thread must be stopped before this frame unwinds
+    struct JoinGuard {
+        std::thread& thread;
+        std::atomic<bool>& cancel;
+        ~JoinGuard() {
+            cancel.store(true, std::memory_order_relaxed);
+            thread.join();
+        }
+    } guard = { decoder, cancel };
+    
+    StageClock::time_point start = StageClock::now();
+    VGMCommand cmd;
+    PipelineEvent event;
+    bool waiting = false;
+    for (;;) {
+        if (!ring.TryPop(event)) {
+            // Read the flag before retrying: everything pushed before it was
+            // set is visible, so an empty ring after that means the end
+            bool done = decodeDone.load(std::memory_order_acquire);
+            if (!ring.TryPop(event)) {
+                if (done) break;
+                if (!waiting) {
+                    encodeStalls++;
+                    waiting = true;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+        }
+        waiting = false;
+        UnpackEvent(event, cmd);
+        if (!encoder.Handle(cmd)) break;
+    }
+    encodeSeconds = Seconds(StageClock::now() - start);
+    return true;
+}
+
+// Smallest piece of data worth a thread of its own
+static const uint32_t kMinChunkBytes = 256 * 1024;
+
+// One piece of a chunked conversion: its own reader over the shared image,
+// and an encoder writing into a commands-only writer
+struct EncodeChunk {
+    EncodeChunk(const VGMHeader& vgmHeader, const ConvertOptions& quiet, uint32_t loopOffset)
+        : options(quiet), encoder(writer, vgmHeader, options, loopOffset) {}
+    
+    ConvertOptions options;
+    VGMReader reader;
+    S98Writer writer;
+    CommandEncoder encoder;
+};
+
+// Split the data at command boundaries, encode the chunks on threads of
+// their own and append them to the main writer in order. Each chunk starts
+// at its absolute sample time, found by the pre-scan, and the wait that
+// spans a boundary is written when the chunks are joined, so the output
+// matches a serial conversion byte for byte. The register optimizer and
+// DAC expansion carry state through the whole song and cannot take part.
+// Returns false, with nothing written and the reason in failure, if the
+// input cannot be split or a chunk met a chip the header does not declare
+// (its device ID would depend on the chunks before); the caller then
+// converts serially.
+static bool RunChunked(VGMReader& reader, CommandEncoder& encoder, uint32_t threads,
+                       uint32_t timerNumerator, uint32_t timerDenominator, uint32_t& chunkCount,
+                       std::string& failure) {
+    const ConvertOptions& options = encoder.options;
+    if (reader.IsCompressed() || !reader.IsSeekable()) {
+        failure = reader.IsCompressed() ? ".vgz input" : "streamed input";
+        return false;
+    }
+    
+    uint32_t chunkBytes = reader.GetInputSize() / threads + 1;
+    if (chunkBytes < kMinChunkBytes) {
+        chunkBytes = kMinChunkBytes;
+    }
+    std::vector<VGMChunk> chunks;
+    uint32_t loopCommand = 0;
+    if (!reader.ScanChunks(chunkBytes, encoder.loopOffset, chunks, loopCommand) || chunks.size() < 2) {
+        failure = "too small to split";
+        return false;
+    }
+    
+    ConvertOptions quiet = options;
+    quiet.log = NULL; // Logged once, after the join
+    std::vector<std::unique_ptr<EncodeChunk>> pieces;
+    for (size_t k = 0; k < chunks.size(); k++) {
+        uint32_t end = k + 1 < chunks.size() ? chunks[k + 1].offset : 0xFFFFFFFF;
+        bool hasLoop = loopCommand >= chunks[k].offset && loopCommand < end;
+        pieces.emplace_back(new EncodeChunk(encoder.vgmHeader, quiet, hasLoop ? encoder.loopOffset : 0));
+    }
+    
+    auto Encode = [&](size_t k) {
+        EncodeChunk& piece = *pieces[k];
+        VGMHeader header;
+        piece.reader.Open(reader.GetInputData(), reader.GetInputSize());
+        piece.reader.ReadHeader(header);
+        piece.reader.Seek(chunks[k].offset);
+        piece.writer.OpenChunk(encoder.writer);
+        
+        CommandEncoder& chunkEncoder = piece.encoder;
+        chunkEncoder.waits.SetTimer(timerNumerator, timerDenominator);
+        if (k > 0) {
+            chunkEncoder.waits.StartChunk(chunks[k].samples);
+            chunkEncoder.totalSamples = (uint32_t)chunks[k].samples;
+        }
+        
+        bool last = k + 1 == chunks.size();
+        uint32_t end = last ? 0xFFFFFFFF : chunks[k + 1].offset;
+        VGMCommand cmd;
+        while (piece.reader.GetCurrentPosition() < end && piece.reader.ReadNextCommand(cmd) &&
+               chunkEncoder.Handle(cmd)) {
+        }
+        if (last) {
+            chunkEncoder.Finish();
+        }
+    };
+    
+    // Chunk 0 runs on this thread; a chunk whose thread cannot be started
+    // runs here too
+    std::vector<std::thread> workers;
+    for (size_t k = 1; k < chunks.size(); k++) {
+        try {
+            workers.emplace_back(Encode, k);
+        } catch (const std::system_error&) {
+            Encode(k);
+        }
+    }
+    Encode(0);
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+    
+    size_t deviceCount = encoder.writer.GetDevices().size();
+    for (size_t k = 0; k < pieces.size(); k++) {
+        if (pieces[k]->writer.GetDevices().size() != deviceCount) {
+            char text[64];
+            snprintf(text, sizeof(text), "chunk %u uses a chip the header does not declare", (unsigned)k);
+            failure = text;
+            return false;
+        }
+    }
+    
+    for (size_t k = 0; k < pieces.size(); k++) {
+        const CommandEncoder& piece = pieces[k]->encoder;
+        encoder.waits.JoinChunk(piece.waits);
+        encoder.writer.AppendChunk(pieces[k]->writer);
+        
+        encoder.totalSamples = piece.totalSamples;
+        if (piece.atLoopPoint) {
+            encoder.atLoopPoint = true;
+            encoder.loopStartSamples = piece.loopStartSamples;
+        }
+        encoder.regWriteCount += piece.regWriteCount;
+        encoder.waitCount += piece.waitCount;
+        encoder.unknownCount += piece.unknownCount;
+        encoder.skippedBlocks += piece.skippedBlocks;
+        encoder.skippedBlockBytes += piece.skippedBlockBytes;
+        for (size_t i = 0; i < 256; i++) {
+            encoder.opcodeCounts[i] += piece.opcodeCounts[i];
+        }
+        if (piece.deviceWrites.size() > encoder.deviceWrites.size()) {
+            encoder.deviceWrites.resize(piece.deviceWrites.size(), 0);
+        }
+        for (size_t i = 0; i < piece.deviceWrites.size(); i++) {
+            encoder.deviceWrites[i] += piece.deviceWrites[i];
+        }
+    }
+    
+    // The per-command messages of the chunks, summed up
+    if (encoder.atLoopPoint) {
+        if (loopCommand != encoder.loopOffset) {
+            LogMessage(options.log, "Warning: Loop offset 0x%X is not a command boundary, using 0x%X\n",
+                    encoder.loopOffset, loopCommand);
+        }
+        LogMessage(options.log, "Loop point set at offset 0x%X (%u samples)\n", loopCommand,
+                encoder.loopStartSamples);
+    }
+    if (encoder.skippedBlocks > 0) {
+        LogMessage(options.log, "Skipped %u data blocks (%u bytes)\n", encoder.skippedBlocks,
+                encoder.skippedBlockBytes);
+    }
+    chunkCount = (uint32_t)chunks.size();
+    return true;
+}
+
+// Largest sample count that divides the time of every command other than a
+// wait (and the loop point), so a timer of that many samples per tick loses
+// nothing. The data ends at endOffset if it is set. Leaves the reader back
+// at the start of the data.
+static uint32_t FindTimeGranularity(VGMReader& reader, uint32_t loopOffset, uint32_t endOffset) {
+    uint64_t time = 0;
+    uint64_t granularity = 0;
+    VGMCommand cmd;
+    while (reader.ReadNextCommand(cmd)) {
+        if (loopOffset > 0 && cmd.offset == loopOffset) {
+            granularity = Gcd(granularity, time);
+        }
+        if (cmd.kind == VGM_KIND_WAIT) {
+            time += cmd.waitSamples;
+            continue;
+        }
+        granularity = Gcd(granularity, time);
+        if (cmd.kind == VGM_KIND_END || (endOffset > 0 && cmd.offset >= endOffset)) {
+            break;
+        }
+        time += cmd.waitSamples; // 0x8n writes, then waits
+    }
+    granularity = Gcd(granularity, time);
+    reader.Reset();
+    
+    // Nothing but silence (or nothing at all): any timer works
+    if (granularity == 0 || granularity > 0xFFFFFFFF) {
+        return 1;
+    }
+    return (uint32_t)granularity;
+}
+
+// Convert the command stream of an opened reader into an opened writer,
+// and build the seek index into seekIndex if it is requested and given
+static bool ConvertOpened(VGMReader& reader, const VGMHeader& vgmHeader, S98Writer& writer,
+                          const ConvertOptions& options, ConversionSummary* summary,
+                          std::vector<uint8_t>* seekIndex) {
+    FILE* log = options.log;
+    
+    // Add devices based on chips used in VGM
+    // We'll discover devices as we parse commands, but add common ones first
+    AddHeaderDevices(writer, log, vgmHeader);
+    
+    // The loop point is placed at the command whose file offset equals the
+    // header's loop offset, so it lands exactly where the VGM loops
+    uint32_t loopOffset = reader.GetLoopOffset();
+    if (loopOffset > 0) {
+        LogMessage(log, "Loop will start at offset 0x%X (loop length: %u samples)\n", 
+                loopOffset, vgmHeader.loopSamples);
+    }
+    
+    // Without a header loop, a song logged several times over can be cut
+    // back to one pass and a loop
+    uint32_t endOffset = 0;
+    bool loopDetected = false;
+    if (loopOffset == 0 && options.detectLoop) {
+        LoopMatch match;
+        if (!reader.IsSeekable()) {
+            LogMessage(log, "Streamed input cannot be read twice; --detect-loop skipped\n");
+        } else if (options.expandDAC) {
+            // Repeated 0x8n commands play on through the PCM bank, so the
+            // expanded writes of two copies may differ
+            LogMessage(log, "--detect-loop does not apply with --expand-dac; skipped\n");
+        } else if (DetectLoop(reader, match)) {
+            loopOffset = match.loopOffset;
+            endOffset = match.endOffset;
+            loopDetected = true;
+            LogMessage(log, "Loop detected at offset 0x%X (%u samples, length %u samples)\n",
+                    match.loopOffset, match.loopStartSamples, match.loopSamples);
+            LogMessage(log, "Data from offset 0x%X repeats the loop; %u samples cut\n",
+                    match.endOffset, match.cutSamples);
+            if (!match.stateMatches) {
+                LogMessage(log, "Note: The chips are in a different state at the first pass through the loop "
+                        "than at its repeats\n");
+            }
+        } else {
+            LogMessage(log, "No repeated song found\n");
+        }
+    }
+    
+    // Timer resolution. Stream writes from DAC expansion fall on arbitrary
+    // samples, so the automatic choice stays at one tick per sample there.
+    uint32_t timerNumerator = 1;
+    uint32_t timerDenominator = 44100;
+    if (options.timerRate == 0) {
+        if (!reader.IsSeekable()) {
+            LogMessage(log, "Streamed input cannot be read twice; --timer auto keeps 44100 Hz\n");
+        } else if (!options.expandDAC) {
+            uint32_t samplesPerTick = FindTimeGranularity(reader, loopOffset, endOffset);
+            uint32_t common = (uint32_t)Gcd(samplesPerTick, 44100);
+            timerNumerator = samplesPerTick / common;
+            timerDenominator = 44100 / common;
+        }
+    } else {
+        timerDenominator = options.timerRate;
+    }
+    writer.SetTimer(timerNumerator, timerDenominator);
+    LogMessage(log, "S98 timer: %u/%u s per tick\n", timerNumerator, timerDenominator);
+    
+    // The writer hands every sync and register write to the index, which
+    // takes a keyframe whenever a sync crosses the next interval
+    uint64_t intervalTicks = (uint64_t)options.seekIndexSeconds * timerDenominator / timerNumerator;
+    SeekIndexBuilder index(intervalTicks > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)intervalTicks);
+    bool indexed = seekIndex && options.seekIndexSeconds > 0;
+    if (indexed) {
+        writer.SetSeekIndex(&index);
+    }
+    
+    LogMessage(log, "Converting VGM data to S98...\n");
+    
+    // Convert VGM commands to S98
+    CommandEncoder encoder(writer, vgmHeader, options, loopOffset, endOffset);
+    encoder.waits.SetTimer(timerNumerator, timerDenominator);
+    uint64_t decodeStalls = 0;
+    uint64_t encodeStalls = 0;
+    double decodeSeconds = 0;
+    double encodeSeconds = 0;
+    reader.SetLoadBlockData(options.expandDAC);
+    uint32_t chunkCount = 0;
+    bool chunked = false;
+    std::string chunkFailure;
+    if (options.expandDAC) {
+        chunkFailure = "--expand-dac";
+    } else if (options.optimizeRegisters) {
+        chunkFailure = "--optimize-regs";
+    } else if (indexed) {
+        chunkFailure = "--seek-index";
+    } else if (endOffset != 0) {
+        chunkFailure = "a detected loop";
+    } else if (options.parallelChunks > 1) {
+        StageClock::time_point start = StageClock::now();
+        chunked = RunChunked(reader, encoder, options.parallelChunks, timerNumerator, timerDenominator,
+                             chunkCount, chunkFailure);
+        encodeSeconds = chunked ? Seconds(StageClock::now() - start) : 0;
+    }
+    // With a single CPU the two stages would only take turns, so stay
+    // serial. DAC expansion needs block payloads, which do not cross the ring.
+    bool pipelined = !chunked && options.pipeline && !options.expandDAC &&
+                     std::thread::hardware_concurrency() != 1 &&
+                     RunPipeline(reader, encoder, decodeStalls, encodeStalls, decodeSeconds, encodeSeconds);
+    if (chunked) {
+        // Decoding and encoding were done by the chunks
+    } else if (!pipelined && options.profileStages) {
+        VGMCommand cmd;
+        StageClock::duration decodeTime(0);
+        StageClock::duration encodeTime(0);
+        StageClock::time_point t0 = StageClock::now();
+        for (;;) {
+            bool more = reader.ReadNextCommand(cmd);
+            StageClock::time_point t1 = StageClock::now();
+            decodeTime += t1 - t0;
+            if (!more) break;
+            more = encoder.Handle(cmd);
+            t0 = StageClock::now();
+            encodeTime += t0 - t1;
+            if (!more) break;
+        }
+        decodeSeconds = Seconds(decodeTime);
+        encodeSeconds = Seconds(encodeTime);
+    } else if (!pipelined) {
+        // Coarse timing: the loop's wall time counts as encoding
+        StageClock::time_point start = StageClock::now();
+        VGMCommand cmd;
+        while (reader.ReadNextCommand(cmd) && encoder.Handle(cmd)) {
+        }
+        encodeSeconds = Seconds(StageClock::now() - start);
+    }
+    encoder.Finish();
+    
+    uint32_t totalSamples = encoder.totalSamples;
+    uint32_t loopStartSamples = encoder.loopStartSamples;
+    bool atLoopPoint = encoder.atLoopPoint;
+    
+    LogMessage(log, "Conversion complete. Total samples: %u\n", totalSamples);
+    if (chunked) {
+        LogMessage(log, "Encoded in %u chunks on separate threads\n", chunkCount);
+    } else if (options.parallelChunks > 1) {
+        LogMessage(log, "Chunked conversion unavailable (%s); converting serially\n", chunkFailure.c_str());
+    }
+    if (pipelined) {
+        LogMessage(log, "Pipeline stalls: decode %llu, encode %llu\n",
+                (unsigned long long)decodeStalls, (unsigned long long)encodeStalls);
+    } else if (options.pipeline) {
+        LogMessage(log, "Pipeline unavailable (single CPU, no threads or DAC expansion); converting serially\n");
+    }
+    
+    if (loopOffset > 0 && !atLoopPoint) {
+        LogMessage(log, "Warning: Loop offset 0x%X lies past the end of the data; no loop written\n", loopOffset);
+    }
+    
+    // Check the loop against the header: it should start loopSamples
+    // before the end of the song
+    bool loopMismatch = false;
+    if (options.verifyLoop && loopOffset > 0 && !loopDetected) {
+        uint32_t expectedStart = vgmHeader.totalSamples - vgmHeader.loopSamples;
+        uint32_t measuredLength = atLoopPoint ? totalSamples - loopStartSamples : 0;
+        loopMismatch = !atLoopPoint || loopStartSamples != expectedStart ||
+                       measuredLength != vgmHeader.loopSamples;
+        if (loopMismatch) {
+            LogMessage(log, "Loop verification FAILED: starts at %u samples (header: %u), "
+                    "length %u samples (header: %u)\n", loopStartSamples, expectedStart,
+                    measuredLength, vgmHeader.loopSamples);
+        } else {
+            LogMessage(log, "Loop verification OK: starts at %u samples, length %u samples\n",
+                    loopStartSamples, measuredLength);
+        }
+    }
+    LogMessage(log, "Register writes: %u, Wait commands: %u\n", 
+            encoder.regWriteCount, encoder.waitCount);
+    if (encoder.unknownCount > 0) {
+        LogMessage(log, "Commands without an S98 equivalent: %u\n", encoder.unknownCount);
+    }
+    if (options.coalesceWaits) {
+        LogMessage(log, "Wait coalescing saved %u bytes\n", encoder.waits.GetBytesSaved());
+    }
+    if (encoder.waits.GetMaxError() > 0) {
+        LogMessage(log, "Max timing error: %.2f samples (%.3f ms)\n",
+                encoder.waits.GetMaxError(), encoder.waits.GetMaxError() * 1000.0 / 44100);
+    }
+    if (options.optimizeRegisters) {
+        LogMessage(log, "Redundant register writes dropped: %u\n", encoder.shadow.GetDroppedCount());
+    }
+    if (options.expandDAC) {
+        LogMessage(log, "DAC writes expanded: %u (PCM bank: %u bytes)\n",
+                encoder.dacWriteCount, encoder.dac.GetBankSize());
+    }
+    
+    // Build tag map: start with GD3 metadata from the VGM
+    StageClock::time_point tagStart = StageClock::now();
+    std::map<std::string, std::string> tags;
+    ExtractGD3Tags(reader, vgmHeader, tags);
+
+    // S98 has no native gain field, so store the VGM volume modifier as a tag.
+    // Volume = 2 ^ (volumeModifier / 32.0); default 0 => factor 1.0.
+    if (vgmHeader.volumeModifier != 0) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%d", (int)vgmHeader.volumeModifier);
+        tags["vgm_volume_modifier"] = buf;
+        LogMessage(log, "Volume modifier tag written: vgm_volume_modifier=%d\n",
+                (int)vgmHeader.volumeModifier);
+    }
+
+    if (!tags.empty()) {
+        writer.WriteTag(tags);
+        LogMessage(log, "Tags written\n");
+    }
+    double tagSeconds = Seconds(StageClock::now() - tagStart);
+    
+    // Finalize S98 file
+    bool finalized = writer.Finalize();
+    writer.SetSeekIndex(NULL);
+    if (!finalized) {
+        if (summary) summary->error = "Could not write output file";
+        return false;
+    }
+    if (indexed) {
+        // Offsets are only final now that the header has its full size
+        index.Serialize(writer.GetDataOffset(), writer.GetFileSize(), *seekIndex);
+        LogMessage(log, "Seek index: %u keyframes every %u s (%u bytes)\n", index.GetKeyframeCount(),
+                options.seekIndexSeconds, (unsigned)seekIndex->size());
+    }
+    
+    if (summary) {
+        summary->totalSamples = totalSamples;
+        summary->registerWrites = encoder.regWriteCount;
+        summary->waitCommands = encoder.waitCount;
+        summary->waitBytesSaved = encoder.waits.GetBytesSaved();
+        summary->registerWritesDropped = encoder.shadow.GetDroppedCount();
+        summary->dacWrites = encoder.dacWriteCount;
+        summary->loopSet = atLoopPoint;
+        summary->loopStartSamples = loopStartSamples;
+        summary->loopDetected = loopDetected && atLoopPoint;
+        summary->inputBytes = reader.GetInputSize();
+        summary->outputBytes = writer.GetFileSize();
+        summary->pipelined = pipelined;
+        summary->chunks = chunkCount;
+        summary->decodeStalls = decodeStalls;
+        summary->encodeStalls = encodeStalls;
+        summary->timerNumerator = timerNumerator;
+        summary->timerDenominator = timerDenominator;
+        summary->maxTimingError = encoder.waits.GetMaxError();
+        summary->unknownCommands = encoder.unknownCount;
+        summary->skippedDataBlocks = encoder.skippedBlocks;
+        summary->skippedDataBytes = encoder.skippedBlockBytes;
+        summary->headerTotalSamples = vgmHeader.totalSamples;
+        summary->headerLoopSamples = vgmHeader.loopSamples;
+        summary->decodeSeconds = decodeSeconds;
+        summary->encodeSeconds = encodeSeconds;
+        summary->tagSeconds = tagSeconds;
+        summary->seekKeyframes = indexed ? index.GetKeyframeCount() : 0;
+        summary->opcodeCounts = encoder.opcodeCounts;
+        
+        const std::vector<S98Device>& devices = writer.GetDevices();
+        summary->devices.resize(devices.size());
+        for (size_t i = 0; i < devices.size(); i++) {
+            DeviceWriteCount& device = summary->devices[i];
+            device.type = devices[i].type;
+            device.instance = devices[i].instance;
+            device.clock = devices[i].clock;
+            device.writes = i < encoder.deviceWrites.size() ? encoder.deviceWrites[i] : 0;
+        }
+    }
+    if (loopMismatch) {
+        if (summary) summary->error = "Loop verification failed";
+        return false;
+    }
+    return true;
+}
+
+bool Convert(const uint8_t* vgm, size_t len, std::vector<uint8_t>& s98, const ConvertOptions& options,
+             ConversionSummary* summary) {
+    std::vector<uint8_t> seekIndex;
+    return Convert(vgm, len, s98, seekIndex, options, summary);
+}
+
+bool Convert(const uint8_t* vgm, size_t len, std::vector<uint8_t>& s98, std::vector<uint8_t>& seekIndex,
+             const ConvertOptions& options, ConversionSummary* summary) {
+    VGMReader reader;
+    VGMHeader vgmHeader;
+    if (!reader.Open(vgm, len)) {
+        if (summary) summary->error = "Could not read input data";
+        return false;
+    }
+    if (!ReadInputHeader(reader, vgmHeader, options, summary)) {
+        return false;
+    }
+    
+    S98Writer writer;
+    writer.Open();
+    if (!ConvertOpened(reader, vgmHeader, writer, options, summary, &seekIndex)) {
+        return false;
+    }
+    writer.TakeOutput(s98);
+    return true;
+}
+
+bool ConvertFile(VGMReader& reader, S98Writer& writer, const char* inputFile, const char* outputFile,
+                 const ConvertOptions& options, ConversionSummary* summary) {
+    // Open VGM file
+    if (!reader.Open(inputFile)) {
+        if (summary) summary->error = "Could not open input file";
+        return false;
+    }
+    
+    // Read VGM header
+    VGMHeader vgmHeader;
+    if (!ReadInputHeader(reader, vgmHeader, options, summary)) {
+        reader.Close();
+        return false;
+    }
+    
+    // Create S98 file
+    if (!writer.Open(outputFile)) {
+        if (summary) summary->error = "Could not create output file";
+        reader.Close();
+        return false;
+    }
+    
+    std::vector<uint8_t> seekIndex;
+    bool ok = ConvertOpened(reader, vgmHeader, writer, options, summary, &seekIndex);
+    writer.Close();
+    reader.Close();
+    
+    if (ok) {
+        LogMessage(options.log, "S98 file written: %s\n", outputFile);
+    }
+    if (ok && options.seekIndexSeconds > 0 && !WriteSeekIndexFile(outputFile, seekIndex)) {
+        if (summary) summary->error = "Could not write seek index";
+        return false;
+    }
+    return ok;
+}
+
+bool ConvertStream(FILE* input, FILE* output, const ConvertOptions& options, ConversionSummary* summary,
+                   std::vector<uint8_t>* seekIndex) {
+    VGMReader reader;
+    VGMHeader vgmHeader;
+    if (!reader.Open(input)) {
+        if (summary) summary->error = "Could not read input data";
+        return false;
+    }
+    if (!ReadInputHeader(reader, vgmHeader, options, summary)) {
+        return false;
+    }
+    
+    S98Writer writer;
+    writer.Open(output);
+    if (!ConvertOpened(reader, vgmHeader, writer, options, summary, seekIndex)) {
+        return false;
+    }
+    return true;
+}
+
+bool ConvertFile(const char* inputFile, const char* outputFile, const ConvertOptions& options,
+                 ConversionSummary* summary) {
+    VGMReader reader;
+    S98Writer writer;
+    return ConvertFile(reader, writer, inputFile, outputFile, options, summary);
+}
+
+bool WriteSeekIndexFile(const char* outputFile, const std::vector<uint8_t>& seekIndex) {
+    std::string path = std::string(outputFile) + ".idx";
+    remove(path.c_str()); // As S98Writer::Open does
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = fwrite(seekIndex.data(), 1, seekIndex.size(), file) == seekIndex.size();
+    return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,130 @@
+#ifndef CONVERTER_H
+#define CONVERTER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <map>
+#include "vgm_reader.h"
+#include "s98_writer.h"
+
+// Bumped whenever the S98 written for the same input and options changes,
+// so conversion cache entries from older builds stop matching
+#define VGM2S98_OUTPUT_VERSION 3
+
+// Conversion settings shared by the in-memory and file entry points
+struct ConvertOptions {
+    FILE* log;          // Progress messages (NULL = silent)
+    bool coalesceWaits; // Merge consecutive VGM waits into one S98 sync
+    bool optimizeRegisters; // Drop register writes that cannot change chip state
+    bool verifyLoop;    // Fail if the loop's sample position disagrees with the header
+    bool pipeline;      // Decode and encode on two threads joined by a lock-free ring
+    bool expandDAC;     // Turn YM2612 PCM (0x8n, DAC streams) into register 0x2A writes
+    uint32_t timerRate; // S98 ticks per second (1-44100); 0 picks the coarsest lossless timer
+    bool profileStages; // Time decode and encode separately (two clock reads per command)
+    uint32_t parallelChunks; // Encode this many pieces of the data on their own threads (0/1 = serial)
+    bool detectLoop;    // Without a header loop, find repeated copies of the song, cut them and loop
+    uint32_t seekIndexSeconds; // Keyframe interval of the seek index sidecar (0 = no index)
+    
+    ConvertOptions() : log(NULL), coalesceWaits(true), optimizeRegisters(false), verifyLoop(false),
+                       pipeline(false), expandDAC(false), timerRate(44100), profileStages(false),
+                       parallelChunks(0), detectLoop(false), seekIndexSeconds(0) {}
+};
+
+// Register writes that went to one S98 device
+struct DeviceWriteCount {
+    S98DeviceType type;
+    uint8_t instance;
+    uint32_t clock;
+    uint32_t writes;
+};
+
+// Outcome of converting one file
+struct ConversionSummary {
+    uint32_t totalSamples;
+    uint32_t registerWrites;
+    uint32_t waitCommands;
+    uint32_t waitBytesSaved; // Sync bytes avoided by wait coalescing
+    uint32_t registerWritesDropped; // Redundant writes removed by the optimizer
+    uint32_t dacWrites;    // YM2612 DAC writes expanded from PCM data
+    bool loopSet;              // A loop point was written
+    uint32_t loopStartSamples; // Sample position of the loop point
+    bool loopDetected;         // The loop was found by options.detectLoop, not the header
+    uint32_t inputBytes;   // Size of the input as stored (compressed for .vgz)
+    uint32_t outputBytes;  // Size of the S98 file written
+    bool pipelined;        // Decode and encode ran on separate threads
+    uint32_t chunks;       // Pieces encoded in parallel (0 = serial)
+    uint64_t decodeStalls; // Times the decoder waited for a full ring to drain
+    uint64_t encodeStalls; // Times the encoder waited for an empty ring to fill
+    uint32_t timerNumerator;   // S98 tick length in seconds, as a fraction
+    uint32_t timerDenominator;
+    double maxTimingError;     // Worst event displacement from tick rounding, in samples
+    uint32_t unknownCommands;  // Commands with no S98 equivalent
+    uint32_t skippedDataBlocks;    // Data blocks not converted, and their payload size
+    uint32_t skippedDataBytes;
+    uint32_t headerTotalSamples;   // The header's view of the song, for loop accuracy
+    uint32_t headerLoopSamples;
+    double decodeSeconds;  // Split only with profileStages or the pipeline; otherwise all encoding
+    double encodeSeconds;
+    double tagSeconds;     // GD3 extraction and tag writing
+    uint32_t seekKeyframes; // Keyframes in the seek index
+    bool cached;           // Served from the conversion cache; only sizes are set
+    std::vector<uint32_t> opcodeCounts;   // Commands per opcode byte (256 entries)
+    std::vector<DeviceWriteCount> devices; // In S98 device order
+    std::string error;     // Set when the conversion fails
+    
+    ConversionSummary() : totalSamples(0), registerWrites(0), waitCommands(0), waitBytesSaved(0),
+                          registerWritesDropped(0), dacWrites(0), loopSet(false), loopStartSamples(0),
+                          loopDetected(false), inputBytes(0), outputBytes(0), pipelined(false), chunks(0),
+                          decodeStalls(0), encodeStalls(0), timerNumerator(1), timerDenominator(44100),
+                          maxTimingError(0), unknownCommands(0), skippedDataBlocks(0), skippedDataBytes(0),
+                          headerTotalSamples(0), headerLoopSamples(0), decodeSeconds(0), encodeSeconds(0),
+                          tagSeconds(0), seekKeyframes(0), cached(false), opcodeCounts(256, 0) {}
+};
+
+// Convert a VGM or VGZ image held in memory to an S98 image in s98.
+// Performs no file I/O.
+bool Convert(const uint8_t* vgm, size_t len, std::vector<uint8_t>& s98, const ConvertOptions& options,
+             ConversionSummary* summary = NULL);
+
+// Same, also building the seek index sidecar (see seek_index.h) into
+// seekIndex when options.seekIndexSeconds is set
+bool Convert(const uint8_t* vgm, size_t len, std::vector<uint8_t>& s98, std::vector<uint8_t>& seekIndex,
+             const ConvertOptions& options, ConversionSummary* summary = NULL);
+
+// Convert one VGM file to S98. With options.seekIndexSeconds the seek index
+// is written next to it, to the output path plus ".idx".
+bool ConvertFile(const char* inputFile, const char* outputFile, const ConvertOptions& options,
+                 ConversionSummary* summary = NULL);
+
+// Same, using the caller's reader/writer pair (e.g. one per batch worker)
+bool ConvertFile(VGMReader& reader, S98Writer& writer, const char* inputFile, const char* outputFile,
+                 const ConvertOptions& options, ConversionSummary* summary = NULL);
+
+// Convert between open streams the caller owns, e.g. stdin to stdout. The
+// input is read front to back in one pass (raw or gzip) and the output is
+// written in one piece at the end, so both may be pipes. --timer auto
+// needs a second pass over the input and falls back to 44100 Hz. The seek
+// index, if requested, is built into seekIndex (if given).
+bool ConvertStream(FILE* input, FILE* output, const ConvertOptions& options, ConversionSummary* summary = NULL,
+                   std::vector<uint8_t>* seekIndex = NULL);
+
+// Write a seek index to the sidecar path of outputFile (outputFile + ".idx")
+bool WriteSeekIndexFile(const char* outputFile, const std::vector<uint8_t>& seekIndex);
+
+// Chip mapping helpers
+S98DeviceType GetS98DeviceType(uint8_t vgmCmd);
+uint32_t GetVGMClock(uint8_t vgmCmd, const VGMHeader& header);
+
+// S98 device instance of the first instance of every chip (kVGMChips row).
+// Chips that share an S98 type (YM2608 and YM2610) are numbered one after
+// the other: header chips in table order, then those only a default clock
+// brings in.
+void GetS98Instances(const VGMHeader& header, uint8_t firstInstance[kVGMChipCount]);
+
+// Extract GD3 tag metadata from an opened VGM into S98 tag names
+bool ExtractGD3Tags(VGMReader& reader, const VGMHeader& header, std::map<std::string, std::string>& tags);
+
+#endif // CONVERTER_H
@@ -0,0 +1,189 @@
+#include "dac_expander.h"
+#include <string.h>
+
+// Chip type of a DAC stream (0x90 tt): index into the VGM header chip list
+// with bit 7 selecting the second chip
+static const uint8_t kStreamChipYM2612 = 0x02;
+static const uint8_t kStreamSecondChip = 0x80;
+
+// Data bank 0x00 holds YM2612 PCM
+static const uint8_t kBankYM2612 = 0x00;
+
+// VGM sample rate; stream frequencies are in writes per second
+static const uint64_t kSampleRate = 44100;
+
+void PCMBank::Append(const uint8_t* bytes, uint32_t size) {
+    blockStart.push_back((uint32_t)data.size());
+    blockSize.push_back(size);
+    data.insert(data.end(), bytes, bytes + size);
+}
+
+DACExpander::DACExpander() : directPos(0) {
+    memset(streams, 0, sizeof(streams));
+}
+
+void DACExpander::AddDataBlock(uint8_t type, const uint8_t* data, uint32_t size) {
+    if (type == kBankYM2612 && data) {
+        bank.Append(data, size);
+    }
+}
+
+bool DACExpander::NextDirectSample(uint8_t& sample) {
+    if (directPos >= bank.GetSize()) {
+        return false;
+    }
+    sample = bank.At(directPos++);
+    return true;
+}
+
+static uint32_t ReadLE32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void DACExpander::StreamCommand(uint8_t cmd, const uint8_t* operands, uint64_t now) {
+    uint8_t id = operands[0];
+    Stream& stream = streams[id];
+    
+    switch (cmd) {
+        case 0x90: {
+            // Setup: chip type, port, register
+            uint8_t chip = operands[1];
+            stream.configured = (chip & ~kStreamSecondChip) == kStreamChipYM2612;
+            stream.instance = (chip & kStreamSecondChip) ? 1 : 0;
+            stream.port = operands[2] & 1;
+            stream.reg = operands[3];
+            break;
+        }
+        case 0x91:
+            // Data: bank type, step size, step base
+            stream.bankType = operands[1];
+            stream.stepSize = operands[2] ? operands[2] : 1;
+            stream.stepBase = operands[3];
+            break;
+        case 0x92:
+            stream.frequency = ReadLE32(operands + 1);
+            break;
+        case 0x93: {
+            // Start: data offset (0xFFFFFFFF keeps the current one), length mode, length
+            uint32_t dataStart = ReadLE32(operands + 1);
+            uint8_t mode = operands[5];
+            uint32_t length = ReadLE32(operands + 6);
+            if (dataStart == 0xFFFFFFFF) {
+                dataStart = stream.dataStart;
+            }
+            uint32_t step = stream.stepSize ? stream.stepSize : 1;
+            switch (mode & 0x0F) {
+                case 0: // Ignore the length: only move the data position, a
+                        // playing stream keeps its timing and length
+                    stream.dataStart = dataStart;
+                    stream.dataCount = stream.count;
+                    return;
+                case 1: // Number of writes
+                    break;
+                case 2: // Milliseconds
+                    length = (uint32_t)((uint64_t)length * stream.frequency / 1000);
+                    break;
+                case 3: // Until the end of the bank
+                    length = dataStart < bank.GetSize() ? (bank.GetSize() - dataStart + step - 1) / step : 0;
+                    break;
+                default: // Reserved (4-15): not a start the spec defines
+                    return;
+            }
+            Start(id, dataStart, length, (mode & 0x80) != 0, now);
+            break;
+        }
+        case 0x94:
+            if (id == 0xFF) {
+                while (!active.empty()) {
+                    Stop(active.back());
+                }
+            } else {
+                Stop(id);
+            }
+            break;
+        case 0x95: {
+            // Fast start: whole data block by ID
+            uint32_t block = (uint32_t)operands[1] | ((uint32_t)operands[2] << 8);
+            if (block >= bank.GetBlockCount()) {
+                Stop(id);
+                break;
+            }
+            uint32_t step = stream.stepSize ? stream.stepSize : 1;
+            Start(id, bank.GetBlockStart(block), (bank.GetBlockSize(block) + step - 1) / step,
+                  (operands[3] & 0x01) != 0, now);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void DACExpander::Start(uint8_t id, uint32_t dataStart, uint32_t length, bool loop, uint64_t now) {
+    Stream& stream = streams[id];
+    Stop(id);
+    stream.dataStart = dataStart;
+    stream.length = length;
+    stream.loop = loop;
+    stream.startTime = now;
+    stream.count = 0;
+    stream.dataCount = 0;
+    if (stream.stepSize == 0) {
+        stream.stepSize = 1; // Data never set up
+    }
+    if (stream.configured && stream.bankType == kBankYM2612 && stream.frequency > 0 && length > 0) {
+        active.push_back(id);
+    }
+}
+
+void DACExpander::Stop(uint8_t id) {
+    for (size_t i = 0; i < active.size(); i++) {
+        if (active[i] == id) {
+            active.erase(active.begin() + i);
+            return;
+        }
+    }
+}
+
+uint64_t DACExpander::WriteTime(const Stream& stream) const {
+    return stream.startTime + stream.count * kSampleRate / stream.frequency;
+}
+
+uint64_t DACExpander::NextWriteTime() const {
+    uint64_t next = WriteTime(streams[active[0]]);
+    for (size_t i = 1; i < active.size(); i++) {
+        uint64_t t = WriteTime(streams[active[i]]);
+        if (t < next) next = t;
+    }
+    return next;
+}
+
+bool DACExpander::PopDueWrite(uint64_t now, DACWrite& write) {
+    for (size_t i = 0; i < active.size();) {
+        Stream& stream = streams[active[i]];
+        if (WriteTime(stream) > now) {
+            i++;
+            continue;
+        }
+        
+        // Looping streams keep their cadence and wrap the data position
+        uint64_t index = stream.count - stream.dataCount;
+        if (stream.loop) index %= stream.length;
+        uint64_t pos = (uint64_t)stream.dataStart + stream.stepBase + index * stream.stepSize;
+        stream.count++;
+        if (pos >= bank.GetSize()) {
+            // Ran off the end of the bank: nothing left to play
+            active.erase(active.begin() + i);
+            continue;
+        }
+        if (!stream.loop && stream.count >= stream.length) {
+            active.erase(active.begin() + i);
+        }
+        
+        write.cmd = (uint8_t)(0x52 + stream.port);
+        write.instance = stream.instance;
+        write.reg = stream.reg;
+        write.data = bank.At((uint32_t)pos);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,100 @@
+#ifndef DAC_EXPANDER_H
+#define DAC_EXPANDER_H
+
+#include <stdint.h>
+#include <vector>
+
+// PCM sample bank built from VGM data blocks of type 0x00 (YM2612 PCM).
+// Blocks are appended into one contiguous buffer in file order, so a
+// sample lookup is a single index and a block lookup (for 0x95) is one
+// table entry.
+class PCMBank {
+public:
+    void Clear() { data.clear(); blockStart.clear(); blockSize.clear(); }
+    void Append(const uint8_t* bytes, uint32_t size);
+    
+    uint32_t GetSize() const { return (uint32_t)data.size(); }
+    uint32_t GetBlockCount() const { return (uint32_t)blockStart.size(); }
+    uint32_t GetBlockStart(uint32_t block) const { return blockStart[block]; }
+    uint32_t GetBlockSize(uint32_t block) const { return blockSize[block]; }
+    
+    // Caller checks offset < GetSize()
+    uint8_t At(uint32_t offset) const { return data[offset]; }
+    
+private:
+    std::vector<uint8_t> data;
+    std::vector<uint32_t> blockStart;
+    std::vector<uint32_t> blockSize;
+};
+
+// One register write produced by DAC expansion
+struct DACWrite {
+    uint8_t cmd;      // VGM write command it stands for (0x52/0x53)
+    uint8_t instance; // Chip instance
+    uint8_t reg;
+    uint8_t data;
+};
+
+// Expands the YM2612 DAC commands that read from the PCM bank into plain
+// register writes:
+//
+//   0x80-0x8F  write the byte at the PCM seek position to register 0x2A,
+//              advance the position, then wait n samples
+//   0x90-0x95  DAC streams: write bank bytes at a fixed frequency
+//
+// Stream write i is due at sample startTime + i * 44100 / frequency, so
+// the writes stay on the exact sample grid however the surrounding waits
+// are split. Only streams that target the YM2612 from bank 0x00 are
+// expanded; other stream targets are ignored.
+class DACExpander {
+public:
+    DACExpander();
+    
+    void AddDataBlock(uint8_t type, const uint8_t* data, uint32_t size);
+    void Seek(uint32_t offset) { directPos = offset; } // 0xE0
+    
+    // 0x8n: next sample for the direct DAC write, false past the bank end
+    bool NextDirectSample(uint8_t& sample);
+    
+    // 0x90-0x95 with their raw operand bytes, at sample time now
+    void StreamCommand(uint8_t cmd, const uint8_t* operands, uint64_t now);
+    
+    bool HasActiveStreams() const { return !active.empty(); }
+    
+    // Time of the earliest pending stream write; HasActiveStreams() must be true
+    uint64_t NextWriteTime() const;
+    
+    // Take the next stream write due at or before now
+    bool PopDueWrite(uint64_t now, DACWrite& write);
+    
+    uint32_t GetBankSize() const { return bank.GetSize(); }
+    
+private:
+    struct Stream {
+        bool configured;
+        uint8_t instance;  // YM2612 instance
+        uint8_t port;
+        uint8_t reg;
+        uint8_t bankType;
+        uint8_t stepSize;
+        uint8_t stepBase;
+        uint32_t frequency;
+        uint32_t dataStart; // Bank offset of the current start
+        uint32_t length;    // Writes per pass
+        bool loop;
+        uint64_t startTime;
+        uint64_t count;     // Writes made since startTime
+        uint64_t dataCount; // count when the data position was last set
+    };
+    
+    PCMBank bank;
+    uint32_t directPos;
+    Stream streams[256];
+    std::vector<uint8_t> active; // IDs of playing streams
+    
+    void Start(uint8_t id, uint32_t dataStart, uint32_t length, bool loop, uint64_t now);
+    void Stop(uint8_t id);
+    uint64_t WriteTime(const Stream& stream) const;
+};
+
+#endif // DAC_EXPANDER_H
@@ -0,0 +1,153 @@
+#include "loop_detector.h"
+#include <algorithm>
+#include <vector>
+
+// Shortest loop worth writing; anything shorter is a repeated figure, not
+// a repeated song
+static const uint32_t kMinLoopSamples = 44100;
+
+// Chip state: one entry per (opcode as normalized, instance, register)
+static const size_t kStateSize = 256 * 2 * 256;
+
+// A command and the samples since the previous one. Register writes fit in
+// 57 bits as they are; other commands are hashed and set the top bit.
+static uint64_t Fingerprint(const VGMCommand& cmd, uint64_t delta) {
+    if (delta > 0xFFFFFFFF) {
+        delta = 0xFFFFFFFF;
+    }
+    if (cmd.kind == VGM_KIND_WRITE) {
+        return (delta << 25) | ((uint64_t)cmd.instance << 24) | ((uint64_t)cmd.cmd << 16) |
+               ((uint64_t)cmd.reg << 8) | cmd.data;
+    }
+    
+    // FNV-1a over the fields. Data block payloads are left out; they almost
+    // always sit in front of the song rather than in it.
+    uint32_t fields[8] = { cmd.opcode, (uint32_t)delta, cmd.waitSamples, cmd.blockType, cmd.blockSize,
+                           cmd.pcmOffset, cmd.reg, cmd.data };
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < 8; i++) {
+        hash = (hash ^ fields[i]) * 0x100000001B3ULL;
+    }
+    for (size_t i = 0; i < sizeof(cmd.operands); i++) {
+        hash = (hash ^ cmd.operands[i]) * 0x100000001B3ULL;
+    }
+    return hash | 0x8000000000000000ULL;
+}
+
+// Apply one write to the chip state. The SN76489 latches a register with
+// one byte and may complete it with a second, so both are kept apart.
+static void ApplyWrite(const VGMCommand& cmd, std::vector<int16_t>& state, uint8_t* snLatch) {
+    uint8_t reg = cmd.reg;
+    if (cmd.cmd == VGM_CMD_SN76489) {
+        uint8_t& latch = snLatch[cmd.instance & 1];
+        if (cmd.data & 0x80) {
+            latch = (cmd.data >> 4) & 7;
+            reg = latch;
+        } else {
+            reg = (uint8_t)(8 + latch);
+        }
+    }
+    state[((size_t)cmd.cmd * 2 + (cmd.instance & 1)) * 256 + reg] = cmd.data;
+}
+
+bool DetectLoop(VGMReader& reader, LoopMatch& match) {
+    match = LoopMatch();
+    if (!reader.IsSeekable()) {
+        return false;
+    }
+    
+    // First pass: fingerprints and the sample time of every command that is
+    // not a plain wait
+    std::vector<uint64_t> prints;
+    std::vector<uint32_t> times;
+    uint64_t time = 0;
+    uint64_t last = 0;
+    VGMCommand cmd;
+    while (reader.ReadNextCommand(cmd) && cmd.kind != VGM_KIND_END) {
+        if (cmd.kind != VGM_KIND_WAIT) {
+            prints.push_back(Fingerprint(cmd, time - last));
+            times.push_back((uint32_t)time);
+            last = time;
+        }
+        time += cmd.waitSamples;
+    }
+    uint64_t endTime = time;
+    reader.Reset();
+    
+    size_t n = prints.size();
+    if (n < 2) {
+        return false;
+    }
+    
+    // z[p] on the reversed fingerprints is the longest common suffix of the
+    // data and the data without its last p commands: command i equals
+    // command i + p for every i from n - p - z[p] on
+    std::reverse(prints.begin(), prints.end());
+    std::vector<uint32_t> z(n, 0);
+    size_t left = 0;
+    size_t right = 0;
+    for (size_t i = 1; i < n; i++) {
+        size_t k = i < right ? std::min(right - i, (size_t)z[i - left]) : 0;
+        while (i + k < n && prints[k] == prints[i + k]) {
+            k++;
+        }
+        z[i] = (uint32_t)k;
+        if (i + k > right) {
+            left = i;
+            right = i + k;
+        }
+    }
+    
+    // The earliest start of a period that repeats nearly whole (the first
+    // command of the first copy often follows the intro after a different
+    // gap); the first (shortest) period wins a tie, as its multiples start
+    // at the same place
+    size_t start = n;
+    size_t period = 0;
+    for (size_t p = 1; p < n; p++) {
+        if ((uint64_t)z[p] * 8 < (uint64_t)p * 7) continue;
+        size_t s = n - p - z[p];
+        if (s >= start || times[s + p] - times[s] < kMinLoopSamples) continue;
+        start = s;
+        period = p;
+    }
+    if (period == 0) {
+        return false;
+    }
+    
+    // Second pass: offsets of the loop start and of the repeat, with the
+    // chip state at each
+    size_t marks[2] = { start, start + period };
+    uint32_t offsets[2] = { 0, 0 };
+    std::vector<int16_t> state(kStateSize, -1);
+    std::vector<int16_t> loopState;
+    uint8_t snLatch[2] = { 0, 0 };
+    size_t index = 0;
+    size_t mark = 0;
+    while (mark < 2 && reader.ReadNextCommand(cmd) && cmd.kind != VGM_KIND_END) {
+        if (cmd.kind == VGM_KIND_WAIT) continue;
+        if (index == marks[mark]) {
+            offsets[mark] = cmd.offset;
+            if (mark == 0) {
+                loopState = state;
+            }
+            mark++;
+        }
+        if (cmd.kind == VGM_KIND_WRITE) {
+            ApplyWrite(cmd, state, snLatch);
+        }
+        index++;
+    }
+    reader.Reset();
+    if (mark < 2) {
+        return false; // The data changed under us
+    }
+    
+    match.loopOffset = offsets[0];
+    match.endOffset = offsets[1];
+    match.loopStartSamples = times[start];
+    match.loopSamples = times[start + period] - times[start];
+    match.cutSamples = (uint32_t)(endTime - times[start + period]);
+    match.stateMatches = state == loopState;
+    return true;
+}
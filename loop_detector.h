@@ -0,0 +1,41 @@
+#ifndef LOOP_DETECTOR_H
+#define LOOP_DETECTOR_H
+
+#include <stdint.h>
+#include "vgm_reader.h"
+
+// A repeat found in the command stream: the commands from endOffset on
+// replay those from loopOffset on, so the data can end at endOffset and
+// loop back to loopOffset without changing what is heard
+struct LoopMatch {
+    uint32_t loopOffset;       // First command of the loop
+    uint32_t endOffset;        // First command of the repeat; the data ends here
+    uint32_t loopStartSamples;
+    uint32_t loopSamples;
+    uint32_t cutSamples;       // Song time from endOffset to the end of the data
+    bool stateMatches;         // Chip state at loopOffset equals the state at endOffset
+    
+    LoopMatch() : loopOffset(0), endOffset(0), loopStartSamples(0), loopSamples(0), cutSamples(0),
+                  stateMatches(false) {}
+};
+
+// Look for a song that was logged several times in a row. Every command
+// other than a wait becomes one fingerprint of itself and the time since the
+// previous one (register writes are packed losslessly, rarer commands are
+// hashed), and the Z-function of the reversed fingerprints gives, for every
+// period at once, how far back the data repeats with that period: linear
+// time and memory. The repeat reaching furthest back wins, shortest period
+// first, if at least 7/8 of a period of one second or more repeats.
+//
+// A second pass finds the offsets and replays the register writes to
+// compare the chip state at the loop start with the state where the repeat
+// begins. The cut is exact either way: the loop replays the repeat from the
+// very state the repeat starts with in the VGM. A mismatch only means the
+// first pass through the loop starts differently (the intro left a register
+// the loop changes), which callers report.
+//
+// Needs a seekable reader; leaves it at the start of the data. Returns false
+// if no repeat qualifies.
+bool DetectLoop(VGMReader& reader, LoopMatch& match);
+
+#endif // LOOP_DETECTOR_H
@@ -0,0 +1,140 @@
+#include "register_shadow.h"
+#include <string.h>
+
+// SN76489 state layout inside PortState::regs: channel register r (0-7)
+// keeps its low 4 bits at [2r] and its high 6 bits at [2r + 1]; the
+// currently latched register number lives at kSNLatch.
+static const uint8_t kSNLatch = 16;
+
+RegisterShadow::RegisterShadow() : droppedCount(0) {
+}
+
+void RegisterShadow::Invalidate() {
+    for (size_t i = 0; i < ports.size(); i++) {
+        memset(ports[i].known, 0, sizeof(ports[i].known));
+    }
+}
+
+RegisterShadow::PortState& RegisterShadow::GetPort(uint8_t deviceId) {
+    if (deviceId >= ports.size()) {
+        size_t oldSize = ports.size();
+        ports.resize((size_t)deviceId + 1);
+        for (size_t i = oldSize; i < ports.size(); i++) {
+            memset(&ports[i], 0, sizeof(PortState));
+        }
+    }
+    return ports[deviceId];
+}
+
+bool RegisterShadow::Write(S98DeviceType type, uint8_t deviceId, uint8_t reg, uint8_t data) {
+    PortState& state = GetPort(deviceId);
+    
+    if (type == S98_DEV_SN76489) {
+        if (!WriteSN76489(state, data)) {
+            droppedCount++;
+            return false;
+        }
+        return true;
+    }
+    
+    bool redundant = !HasSideEffect(type, deviceId & 1, reg) && IsKnown(state, reg) && state.regs[reg] == data;
+    if (redundant) {
+        droppedCount++;
+        return false;
+    }
+    
+    state.regs[reg] = data;
+    SetKnown(state, reg);
+    return true;
+}
+
+bool RegisterShadow::WriteSN76489(PortState& state, uint8_t data) {
+    bool latchKnown = IsKnown(state, kSNLatch);
+    uint8_t target;
+    uint8_t field;
+    uint8_t value;
+    
+    if (data & 0x80) {
+        // Latch byte 1rrtdddd: select register, write its low 4 bits
+        target = (data >> 4) & 7;
+        field = target * 2;
+        value = data & 0x0F;
+        
+        // Redundant only if it neither moves the latch nor changes the value
+        bool redundant = latchKnown && state.regs[kSNLatch] == target &&
+                         IsKnown(state, field) && state.regs[field] == value;
+        
+        state.regs[kSNLatch] = target;
+        SetKnown(state, kSNLatch);
+        if (redundant && target != 6) { // Noise control write resets the LFSR
+            return false;
+        }
+        state.regs[field] = value;
+        SetKnown(state, field);
+        return true;
+    }
+    
+    // Data byte 0-dddddd: goes to whichever register is latched
+    if (!latchKnown) {
+        return true;
+    }
+    target = state.regs[kSNLatch];
+    if (target == 6) {
+        // Noise control write resets the LFSR; the data byte sets the
+        // noise mode like a latch byte does
+        state.regs[12] = data & 0x0F;
+        SetKnown(state, 12);
+        return true;
+    }
+    if (target & 1) {
+        field = target * 2;     // Volume: 4-bit attenuation
+        value = data & 0x0F;
+    } else {
+        field = target * 2 + 1; // Tone: high 6 bits of the period
+        value = data & 0x3F;
+    }
+    
+    if (IsKnown(state, field) && state.regs[field] == value) {
+        return false;
+    }
+    state.regs[field] = value;
+    SetKnown(state, field);
+    return true;
+}
+
+bool RegisterShadow::HasSideEffect(S98DeviceType type, uint8_t port, uint8_t reg) {
+    switch (type) {
+        case S98_DEV_OPN:
+        case S98_DEV_OPN2:
+        case S98_DEV_OPNA:
+            if (reg >= 0xA0 && reg <= 0xAF) {
+                return true; // F-number writes go through a shared MSB latch
+            }
+            if (port == 0) {
+                // SSG envelope shape restarts the envelope, 0x10 is rhythm
+                // key-on, 0x20-0x2F hold key-on, timers/reset, DAC and
+                // prescaler registers; only the LFO at 0x22 is plain state
+                return reg == 0x0D || reg == 0x10 || (reg >= 0x20 && reg <= 0x2F && reg != 0x22);
+            }
+            // Port 1 0x00-0x2F: ADPCM control, FIFO data and flag registers
+            return reg <= 0x2F;
+        case S98_DEV_OPM:
+            // Test/LFO reset, key-on, timers/IRQ control, shared AMD/PMD register
+            return reg == 0x01 || reg == 0x08 || (reg >= 0x10 && reg <= 0x14) || reg == 0x19;
+        case S98_DEV_OPLL:
+            // Rhythm control and test
+            return reg == 0x0E || reg == 0x0F;
+        case S98_DEV_OPL:
+        case S98_DEV_OPL2:
+        case S98_DEV_OPL3:
+            // Test, timers and IRQ/timer control
+            return reg >= 0x01 && reg <= 0x04;
+        case S98_DEV_PSG:
+        case S98_DEV_AY8910:
+            // Writing the envelope shape restarts the envelope
+            return reg == 0x0D;
+        default:
+            // Unknown chip: never assume a write is redundant
+            return true;
+    }
+}
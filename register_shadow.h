@@ -0,0 +1,55 @@
+#ifndef REGISTER_SHADOW_H
+#define REGISTER_SHADOW_H
+
+#include <stdint.h>
+#include <vector>
+#include "s98_writer.h"
+
+// Shadow copy of the registers written to every S98 device port (one S98
+// device ID per port). Used to drop writes that cannot change chip state.
+//
+// Registers with side effects beyond their stored value (key-on, timer
+// control, envelope restart, FIFO data, address latches, ...) are never
+// considered redundant. The SN76489 has no addressable registers; its
+// latch/data byte protocol is modelled explicitly.
+class RegisterShadow {
+public:
+    RegisterShadow();
+    
+    // Record a write to deviceId (S98 base ID + port). Returns false if the
+    // write is redundant and can be dropped, true if it must be kept.
+    bool Write(S98DeviceType type, uint8_t deviceId, uint8_t reg, uint8_t data);
+    
+    // Forget all known values, e.g. at the loop point where playback may
+    // arrive with the state from the end of the song
+    void Invalidate();
+    
+    uint32_t GetDroppedCount() const { return droppedCount; }
+    
+    // Register values by S98 device ID. The SN76489 keeps channel register
+    // r in [2r] (low 4 bits) and [2r + 1] (high 6 bits), its latch in [16].
+    struct PortState {
+        uint8_t regs[256];
+        uint8_t known[32]; // Bit set = regs[] entry holds the chip's value
+    };
+    
+    // Ports written so far; IDs past the end have no known registers
+    const std::vector<PortState>& GetPorts() const { return ports; }
+    
+private:
+    std::vector<PortState> ports; // Indexed by S98 device ID
+    uint32_t droppedCount;
+    
+    PortState& GetPort(uint8_t deviceId);
+    bool WriteSN76489(PortState& state, uint8_t data);
+    static bool HasSideEffect(S98DeviceType type, uint8_t port, uint8_t reg);
+    
+    static bool IsKnown(const PortState& state, uint8_t index) {
+        return (state.known[index >> 3] >> (index & 7)) & 1;
+    }
+    static void SetKnown(PortState& state, uint8_t index) {
+        state.known[index >> 3] |= (uint8_t)(1 << (index & 7));
+    }
+};
+
+#endif // REGISTER_SHADOW_H
@@ -0,0 +1,285 @@
+#include "reverse_converter.h"
+#include "convert_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+uint8_t GetVGMCommand(S98DeviceType type, uint8_t port) {
+    // The first chip row of the type wins (the YM2608 for OPNA)
+    if (type == S98_DEV_NONE) {
+        return 0;
+    }
+    for (size_t chip = 0; chip < kVGMChipCount; chip++) {
+        const VGMChipDescriptor& desc = kVGMChips[chip];
+        if (desc.s98Type == type) {
+            return port < desc.ports ? (uint8_t)(desc.command + port) : 0;
+        }
+    }
+    return 0;
+}
+
+void BuildGD3Strings(const std::map<std::string, std::string>& tags, std::vector<std::string>& strings) {
+    std::map<std::string, std::string> lower;
+    for (const auto& pair : tags) {
+        std::string key = pair.first;
+        for (size_t i = 0; i < key.size(); i++) {
+            key[i] = (char)tolower((unsigned char)key[i]);
+        }
+        lower[key] = pair.second;
+    }
+    auto Get = [&lower](const char* key) -> std::string {
+        std::map<std::string, std::string>::const_iterator it = lower.find(key);
+        return it != lower.end() ? it->second : std::string();
+    };
+    
+    // S98 tags carry one language; it goes to the English fields, as
+    // ExtractGD3Tags prefers those
+    strings.assign(11, std::string());
+    strings[0] = Get("title");
+    strings[2] = Get("game");
+    strings[4] = Get("system");
+    strings[6] = Get("artist");
+    strings[8] = Get("year");
+    strings[9] = Get("s98by");
+    strings[10] = Get("comment");
+}
+
+// Where the writes of one S98 device ID go
+struct VGMRoute {
+    uint8_t cmd;      // 0 = no VGM equivalent
+    uint8_t instance;
+};
+
+static bool ConvertS98Opened(S98Reader& reader, const S98Header& header, VGMWriter& writer,
+                             const ConvertOptions& options, ConversionSummary* summary) {
+    FILE* log = options.log;
+    
+    LogMessage(log, "S98 timer: %u/%u s per tick\n", header.timerNumerator, header.timerDenominator);
+    LogMessage(log, "Devices: %u\n", (unsigned)header.devices.size());
+    
+    // Map each S98 device onto a VGM chip. VGM holds two chips of a kind
+    // (bit 30 of the clock), sharing one clock.
+    VGMRoute routes[256] = {};
+    uint8_t chipCount[256] = {};
+    for (size_t i = 0; i < header.devices.size(); i++) {
+        const S98Device& dev = header.devices[i];
+    
+        // The YM2149 has no S98 mapping of its own; VGM writes it as an
+        // AY8910 variant
+        S98DeviceType type = dev.type == S98_DEV_PSG ? S98_DEV_AY8910 : dev.type;
+        uint8_t cmd = GetVGMCommand(type, 0);
+        if (cmd == 0) {
+            LogMessage(log, "Warning: Device %u (type %u) has no VGM equivalent; its writes are dropped\n",
+                    (unsigned)i, (unsigned)dev.type);
+            continue;
+        }
+        uint8_t instance = chipCount[cmd]++;
+        if (instance > 1) {
+            LogMessage(log, "Warning: Device %u is a third chip of type %u; its writes are dropped\n",
+                    (unsigned)i, (unsigned)dev.type);
+            continue;
+        }
+        if (instance == 0) {
+            writer.SetClock(cmd, dev.clock);
+            if (dev.type == S98_DEV_PSG) {
+                writer.SetAY8910Type(0x10);
+            }
+        } else {
+            if (dev.clock != writer.GetClock(cmd)) {
+                LogMessage(log, "Warning: Second chip of type %u runs at %u Hz; VGM uses the first chip's %u Hz\n",
+                        (unsigned)dev.type, dev.clock, writer.GetClock(cmd));
+            }
+            writer.SetClock(cmd, writer.GetClock(cmd), true);
+        }
+        routes[i * 2].cmd = cmd;
+        routes[i * 2].instance = instance;
+        routes[i * 2 + 1].cmd = GetVGMCommand(type, 1);
+        routes[i * 2 + 1].instance = instance;
+    }
+    
+    // One tick lasts tickNum/tickDen samples. Ticks are rounded to samples
+    // by absolute time, so rounding errors never add up.
+    uint64_t tickNum = (uint64_t)header.timerNumerator * 44100;
+    uint64_t tickDen = header.timerDenominator;
+    uint64_t common = Gcd(tickNum, tickDen);
+    tickNum /= common;
+    tickDen /= common;
+    
+    LogMessage(log, "Converting S98 data to VGM...\n");
+    
+    uint64_t ticks = 0;
+    uint64_t samplesWritten = 0;
+    uint64_t maxErrorScaled = 0; // |ticks * tickNum - samples * tickDen|
+    bool loopReached = false;
+    uint32_t loopStartSamples = 0;
+    uint32_t regWriteCount = 0;
+    uint32_t waitCount = 0;
+    uint32_t droppedCount = 0;
+    std::vector<uint32_t> deviceWrites(header.devices.size(), 0);
+    
+    auto FlushWait = [&]() {
+        uint64_t exact = ticks * tickNum;
+        uint64_t samples = tickDen == 1 ? exact : (exact + tickDen / 2) / tickDen;
+        if (samples <= samplesWritten) return;
+        uint64_t scaled = samples * tickDen;
+        uint64_t error = scaled > exact ? scaled - exact : exact - scaled;
+        if (error > maxErrorScaled) maxErrorScaled = error;
+        writer.WriteWait((uint32_t)(samples - samplesWritten));
+        samplesWritten = samples;
+    };
+    
+    S98Command cmd;
+    while (reader.ReadNextCommand(cmd)) {
+        if (!loopReached && header.loopOffset > 0 && cmd.offset >= header.loopOffset) {
+            if (cmd.offset != header.loopOffset) {
+                LogMessage(log, "Warning: Loop offset 0x%X is not a command boundary, using 0x%X\n",
+                        header.loopOffset, cmd.offset);
+            }
+            FlushWait();
+            writer.SetLoopPoint();
+            loopReached = true;
+            loopStartSamples = writer.GetTotalSamples();
+            LogMessage(log, "Loop point set at offset 0x%X (%u samples)\n", cmd.offset, loopStartSamples);
+        }
+    
+        if (cmd.kind == S98_CMD_END) {
+            break;
+        }
+        if (cmd.kind == S98_CMD_WAIT) {
+            ticks += cmd.ticks;
+            waitCount++;
+            continue;
+        }
+    
+        const VGMRoute& route = routes[cmd.deviceId];
+        if (route.cmd == 0) {
+            droppedCount++;
+            continue;
+        }
+        FlushWait();
+        writer.WriteRegister(route.cmd, route.instance, cmd.reg, cmd.data);
+        regWriteCount++;
+        deviceWrites[cmd.deviceId / 2]++;
+    }
+    FlushWait();
+    writer.WriteEnd();
+    
+    if (header.loopOffset > 0 && !loopReached) {
+        LogMessage(log, "Warning: Loop offset 0x%X lies past the end of the data; no loop written\n",
+                header.loopOffset);
+    }
+    
+    double maxTimingError = (double)maxErrorScaled / (double)tickDen;
+    LogMessage(log, "Conversion complete. Total samples: %u\n", writer.GetTotalSamples());
+    LogMessage(log, "Register writes: %u, Wait commands: %u\n", regWriteCount, waitCount);
+    if (droppedCount > 0) {
+        LogMessage(log, "Writes to devices without a VGM equivalent: %u\n", droppedCount);
+    }
+    if (maxTimingError > 0) {
+        LogMessage(log, "Max timing error: %.2f samples (%.3f ms)\n", maxTimingError, maxTimingError * 1000.0 / 44100);
+    }
+    
+    // Tags: the volume modifier has a header field, the rest go to GD3
+    std::map<std::string, std::string> tags;
+    if (reader.ReadTags(tags)) {
+        std::map<std::string, std::string>::iterator volume = tags.find("vgm_volume_modifier");
+        if (volume != tags.end()) {
+            writer.SetVolumeModifier((int8_t)atoi(volume->second.c_str()));
+            tags.erase(volume);
+        }
+        if (!tags.empty()) {
+            std::vector<std::string> strings;
+            BuildGD3Strings(tags, strings);
+            writer.WriteGD3(strings);
+            LogMessage(log, "GD3 tags written\n");
+        }
+    }
+    
+    if (!writer.Finalize()) {
+        if (summary) summary->error = "Could not write output file";
+        return false;
+    }
+    
+    if (summary) {
+        summary->totalSamples = writer.GetTotalSamples();
+        summary->registerWrites = regWriteCount;
+        summary->waitCommands = waitCount;
+        summary->loopSet = loopReached;
+        summary->loopStartSamples = loopStartSamples;
+        summary->inputBytes = reader.GetFileSize();
+        summary->outputBytes = writer.GetFileSize();
+        summary->timerNumerator = header.timerNumerator;
+        summary->timerDenominator = header.timerDenominator;
+        summary->maxTimingError = maxTimingError;
+        summary->unknownCommands = droppedCount;
+    
+        summary->devices.resize(header.devices.size());
+        for (size_t i = 0; i < header.devices.size(); i++) {
+            DeviceWriteCount& device = summary->devices[i];
+            device.type = header.devices[i].type;
+            device.instance = header.devices[i].instance;
+            device.clock = header.devices[i].clock;
+            device.writes = deviceWrites[i];
+        }
+    }
+    return true;
+}
+
+bool ConvertS98(const uint8_t* s98, size_t len, std::vector<uint8_t>& vgm, const ConvertOptions& options,
+                ConversionSummary* summary) {
+    S98Reader reader;
+    S98Header header;
+    if (!reader.Open(s98, len)) {
+        if (summary) summary->error = "Could not read input data";
+        return false;
+    }
+    if (!reader.ReadHeader(header)) {
+        if (summary) summary->error = "Invalid or unsupported S98 file (v3 only)";
+        return false;
+    }
+    
+    VGMWriter writer;
+    writer.Open();
+    if (!ConvertS98Opened(reader, header, writer, options, summary)) {
+        return false;
+    }
+    writer.TakeOutput(vgm);
+    return true;
+}
+
+bool ConvertS98File(S98Reader& reader, VGMWriter& writer, const char* inputFile, const char* outputFile,
+                    const ConvertOptions& options, ConversionSummary* summary) {
+    if (!reader.Open(inputFile)) {
+        if (summary) summary->error = "Could not open input file";
+        return false;
+    }
+    
+    S98Header header;
+    if (!reader.ReadHeader(header)) {
+        if (summary) summary->error = "Invalid or unsupported S98 file (v3 only)";
+        reader.Close();
+        return false;
+    }
+    
+    if (!writer.Open(outputFile)) {
+        if (summary) summary->error = "Could not create output file";
+        reader.Close();
+        return false;
+    }
+    
+    bool ok = ConvertS98Opened(reader, header, writer, options, summary);
+    writer.Close();
+    reader.Close();
+    
+    if (ok) {
+        LogMessage(options.log, "VGM file written: %s\n", outputFile);
+    }
+    return ok;
+}
+
+bool ConvertS98File(const char* inputFile, const char* outputFile, const ConvertOptions& options,
+                    ConversionSummary* summary) {
+    S98Reader reader;
+    VGMWriter writer;
+    return ConvertS98File(reader, writer, inputFile, outputFile, options, summary);
+}
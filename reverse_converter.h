@@ -0,0 +1,39 @@
+#ifndef REVERSE_CONVERTER_H
+#define REVERSE_CONVERTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <map>
+#include "converter.h"
+#include "s98_reader.h"
+#include "vgm_writer.h"
+
+// S98 to VGM, the reverse of Convert. Chips are mapped back through the
+// chip table (chip_table.h), so exactly the chips the forward direction
+// writes come back; the S98 timer is rounded onto the 44100 Hz VGM clock by absolute
+// time. Only options.log is used.
+
+// Convert an S98 image held in memory to a VGM image in vgm.
+// Performs no file I/O.
+bool ConvertS98(const uint8_t* s98, size_t len, std::vector<uint8_t>& vgm, const ConvertOptions& options,
+                ConversionSummary* summary = NULL);
+
+// Convert one S98 file to VGM
+bool ConvertS98File(const char* inputFile, const char* outputFile, const ConvertOptions& options,
+                    ConversionSummary* summary = NULL);
+
+// Same, using the caller's reader/writer pair
+bool ConvertS98File(S98Reader& reader, VGMWriter& writer, const char* inputFile, const char* outputFile,
+                    const ConvertOptions& options, ConversionSummary* summary = NULL);
+
+// VGM command that writes port 0 or 1 of an S98 device type; 0 if VGM
+// cannot carry it
+uint8_t GetVGMCommand(S98DeviceType type, uint8_t port);
+
+// The 11 GD3 strings for S98 tags (keys in any case), the inverse of
+// ExtractGD3Tags
+void BuildGD3Strings(const std::map<std::string, std::string>& tags, std::vector<std::string>& strings);
+
+#endif // REVERSE_CONVERTER_H
@@ -0,0 +1,244 @@
+#include "s98_reader.h"
+#include <string.h>
+
+// Bytes read from the file per refill; commands are read front to back
+static const uint32_t kWindowSize = 64 * 1024;
+
+S98Reader::S98Reader() : file(NULL), opened(false), fileSize(0), window(NULL), windowBase(0),
+                         windowEnd(0), dataOffset(0), tagOffset(0), currentPos(0) {
+}
+
+S98Reader::~S98Reader() {
+    Close();
+}
+
+bool S98Reader::Open(const char* filename) {
+    Close();
+    
+    file = fopen(filename, "rb");
+    if (!file) {
+        return false;
+    }
+    
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        size = ftell(file);
+    }
+    if (size < 0 || (unsigned long)size > 0xFFFFFFFFUL) {
+        Close();
+        return false;
+    }
+    fileSize = (uint32_t)size;
+    opened = true;
+    return true;
+}
+
+bool S98Reader::Open(const uint8_t* data, size_t size) {
+    Close();
+    
+    if (size > 0xFFFFFFFF) {
+        return false;
+    }
+    
+    // Caller-owned bytes; they must outlive the reader's use of them
+    window = data;
+    windowBase = 0;
+    windowEnd = (uint32_t)size;
+    fileSize = (uint32_t)size;
+    opened = true;
+    return true;
+}
+
+void S98Reader::Close() {
+    if (file) {
+        fclose(file);
+        file = NULL;
+    }
+    opened = false;
+    fileSize = 0;
+    window = NULL;
+    windowBase = 0;
+    windowEnd = 0;
+    buffer.clear();
+    dataOffset = 0;
+    tagOffset = 0;
+    currentPos = 0;
+}
+
+const uint8_t* S98Reader::Refill(uint32_t offset, uint32_t length) {
+    if (!file || offset > fileSize || fileSize - offset < length) {
+        return NULL; // In-memory images are a single window
+    }
+    
+    uint32_t size = length > kWindowSize ? length : kWindowSize;
+    if (size > fileSize - offset) {
+        size = fileSize - offset;
+    }
+    buffer.resize(size);
+    if (fseek(file, (long)offset, SEEK_SET) != 0 || fread(buffer.data(), 1, size, file) != size) {
+        return NULL;
+    }
+    window = buffer.data();
+    windowBase = offset;
+    windowEnd = offset + size;
+    return window;
+}
+
+uint32_t S98Reader::ReadUint32(uint32_t offset) {
+    const uint8_t* p = Fetch(offset, 4);
+    if (!p) {
+        return 0;
+    }
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool S98Reader::ReadHeader(S98Header& header) {
+    if (!opened) {
+        return false;
+    }
+    
+    // Check magic; only v3 has the device table and [S98] tags
+    const uint8_t* magic = Fetch(0, 0x20);
+    if (!magic || memcmp(magic, "S983", 4) != 0) {
+        return false;
+    }
+    
+    header = S98Header();
+    header.timerNumerator = ReadUint32(0x04);
+    header.timerDenominator = ReadUint32(0x08);
+    header.compression = ReadUint32(0x0C);
+    header.tagOffset = ReadUint32(0x10);
+    header.dataOffset = ReadUint32(0x14);
+    header.loopOffset = ReadUint32(0x18);
+    uint32_t deviceCount = ReadUint32(0x1C);
+    
+    // Zero timer fields mean the v1 default of 10 ms per tick
+    if (header.timerNumerator == 0) header.timerNumerator = 10;
+    if (header.timerDenominator == 0) header.timerDenominator = 1000;
+    
+    // Device IDs are one byte (two per device) and 0xFD-0xFF are commands
+    if (deviceCount > 0x7E || header.dataOffset < 0x20 + deviceCount * 16 || header.dataOffset > fileSize) {
+        return false;
+    }
+    
+    for (uint32_t i = 0; i < deviceCount; i++) {
+        uint32_t offset = 0x20 + i * 16;
+        S98Device dev;
+        dev.type = (S98DeviceType)ReadUint32(offset);
+        dev.clock = ReadUint32(offset + 0x04);
+        dev.pan = ReadUint32(offset + 0x08);
+        dev.deviceId = (uint8_t)(i * 2);
+        for (size_t j = 0; j < header.devices.size(); j++) {
+            if (header.devices[j].type == dev.type) dev.instance++;
+        }
+        header.devices.push_back(dev);
+    }
+    
+    // No device table means a single OPNA
+    if (deviceCount == 0) {
+        S98Device dev;
+        dev.type = S98_DEV_OPNA;
+        dev.clock = 7987200;
+        header.devices.push_back(dev);
+    }
+    
+    dataOffset = header.dataOffset;
+    tagOffset = header.tagOffset;
+    currentPos = dataOffset;
+    return true;
+}
+
+bool S98Reader::ReadNextCommand(S98Command& cmd) {
+    if (!opened || dataOffset == 0) {
+        return false;
+    }
+    
+    const uint8_t* p = Fetch(currentPos, 1);
+    if (!p) {
+        return false;
+    }
+    
+    cmd = S98Command();
+    cmd.offset = currentPos;
+    uint8_t byte = *p;
+    currentPos++;
+    
+    switch (byte) {
+        case 0xFF:
+            cmd.kind = S98_CMD_WAIT;
+            cmd.ticks = 1;
+            return true;
+        case 0xFE: {
+            // n ticks = 0xFE + varint(n - 2), 7 bits per byte, low bits first
+            uint32_t value = 0;
+            for (int shift = 0;; shift += 7) {
+                if (shift > 28 || !(p = Fetch(currentPos, 1))) return false;
+                currentPos++;
+                if (shift == 28 && (*p & 0x70)) return false; // Past 32 bits
+                value |= (uint32_t)(*p & 0x7F) << shift;
+                if (!(*p & 0x80)) break;
+            }
+            if (value > 0xFFFFFFFD) return false; // n would not fit in 32 bits
+            cmd.kind = S98_CMD_WAIT;
+            cmd.ticks = value + 2;
+            return true;
+        }
+        case 0xFD:
+            cmd.kind = S98_CMD_END;
+            return true;
+        default:
+            if (!(p = Fetch(currentPos, 2))) return false;
+            currentPos += 2;
+            cmd.kind = S98_CMD_WRITE;
+            cmd.deviceId = byte;
+            cmd.reg = p[0];
+            cmd.data = p[1];
+            return true;
+    }
+}
+
+void S98Reader::Reset() {
+    if (opened && dataOffset > 0) {
+        currentPos = dataOffset;
+    }
+}
+
+bool S98Reader::ReadTags(std::map<std::string, std::string>& tags) {
+    if (!opened || tagOffset == 0) {
+        return false;
+    }
+    
+    const uint8_t* p = Fetch(tagOffset, 5);
+    if (!p || memcmp(p, "[S98]", 5) != 0) {
+        return false;
+    }
+    uint32_t pos = tagOffset + 5;
+    
+    // Optional UTF-8 BOM
+    if ((p = Fetch(pos, 3)) && p[0] == 0xEF && p[1] == 0xBB && p[2] == 0xBF) {
+        pos += 3;
+    }
+    
+    // key=value lines separated by 0x0A, up to a NUL or the end of the file
+    std::string line;
+    while ((p = Fetch(pos, 1)) && *p != 0) {
+        pos++;
+        if (*p != 0x0A) {
+            line += (char)*p;
+            continue;
+        }
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line.erase(line.size() - 1);
+        }
+        size_t eq = line.find('=');
+        if (eq != std::string::npos) {
+            tags[line.substr(0, eq)] = line.substr(eq + 1);
+        }
+        line.clear();
+    }
+    size_t eq = line.find('=');
+    if (eq != std::string::npos) {
+        tags[line.substr(0, eq)] = line.substr(eq + 1);
+    }
+    return true;
+}
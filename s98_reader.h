@@ -0,0 +1,94 @@
+#ifndef S98_READER_H
+#define S98_READER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <vector>
+#include <string>
+#include <map>
+#include "s98_writer.h"
+
+// S98 v3 header as stored
+struct S98Header {
+    uint32_t timerNumerator;   // One tick lasts numerator/denominator seconds
+    uint32_t timerDenominator;
+    uint32_t compression;
+    uint32_t tagOffset;        // Absolute; 0 = no tags
+    uint32_t dataOffset;
+    uint32_t loopOffset;       // Absolute; 0 = no loop
+    
+    // Device table in file order. Entry i owns device IDs 2i and 2i+1;
+    // instance counts earlier entries of the same type, as S98Writer does.
+    std::vector<S98Device> devices;
+    
+    S98Header() : timerNumerator(0), timerDenominator(0), compression(0), tagOffset(0),
+                  dataOffset(0), loopOffset(0) {}
+};
+
+enum S98CommandKind {
+    S98_CMD_WRITE,  // Register write: deviceId, reg, data
+    S98_CMD_WAIT,   // 0xFF (1 tick) or 0xFE varint
+    S98_CMD_END     // 0xFD
+};
+
+struct S98Command {
+    uint32_t offset;   // Absolute file offset of the command byte
+    uint8_t kind;      // S98CommandKind
+    uint8_t deviceId;  // Device entry * 2 + port
+    uint8_t reg;
+    uint8_t data;
+    uint32_t ticks;    // For waits
+    
+    S98Command() : offset(0), kind(S98_CMD_END), deviceId(0), reg(0), data(0), ticks(0) {}
+};
+
+// S98 Reader class, the counterpart of S98Writer. Files are read through a
+// bounded window refilled in order, so a long command stream is never held
+// in memory at once.
+class S98Reader {
+public:
+    S98Reader();
+    ~S98Reader();
+    
+    bool Open(const char* filename);
+    bool Open(const uint8_t* data, size_t size); // In-memory S98 image, not copied
+    void Close();
+    
+    bool ReadHeader(S98Header& header);
+    bool ReadNextCommand(S98Command& cmd);
+    void Reset(); // Back to the first command
+    
+    // [S98] key=value tags; false when there are none (or only a v1/v2 title)
+    bool ReadTags(std::map<std::string, std::string>& tags);
+    
+    bool IsOpen() const { return opened; }
+    uint32_t GetFileSize() const { return fileSize; }
+    
+private:
+    FILE* file;            // NULL for in-memory images
+    bool opened;
+    uint32_t fileSize;
+    
+    // Bytes [windowBase, windowEnd) of the file are addressable through window
+    const uint8_t* window;
+    uint32_t windowBase;
+    uint32_t windowEnd;
+    std::vector<uint8_t> buffer; // Window storage for files
+    
+    uint32_t dataOffset;
+    uint32_t tagOffset;
+    uint32_t currentPos;
+    
+    // Pointer to length bytes at offset, or NULL past the end of the file
+    const uint8_t* Fetch(uint32_t offset, uint32_t length) {
+        if (offset >= windowBase && offset <= windowEnd && windowEnd - offset >= length) {
+            return window + (offset - windowBase);
+        }
+        return Refill(offset, length);
+    }
+    const uint8_t* Refill(uint32_t offset, uint32_t length);
+    uint32_t ReadUint32(uint32_t offset);
+};
+
+#endif // S98_READER_H
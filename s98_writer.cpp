@@ -1,9 +1,11 @@
 #include "s98_writer.h"
+#include "seek_index.h"
 #include <string.h>
 #include <algorithm>
 
-S98Writer::S98Writer() : file(NULL), dataStartOffset(0), loopOffset(0), 
-                         tagOffset(0), currentDataPos(0), loopSet(false), nextDeviceId(0) {
+S98Writer::S98Writer() : file(NULL), ownsFile(false), opened(false), dataStartOffset(0), loopOffset(0), 
+                         tagOffset(0), currentDataPos(0), loopSet(false), finalized(false), chunk(false),
+                         timerNumerator(1), timerDenominator(44100), index(NULL), nextDeviceId(0) {
 }
 
 S98Writer::~S98Writer() {
@@ -13,25 +15,76 @@ S98Writer::~S98Writer() {
 bool S98Writer::Open(const char* filename) {
     Close();
     
+    // Replace rather than rewrite: an old output may be a hard link (e.g.
+    // to a conversion cache entry) that must keep its contents
+    remove(filename);
     file = fopen(filename, "wb");
     if (!file) {
         return false;
     }
+    ownsFile = true;
     
-    // Write placeholder header (will be finalized later)
+    return Open();
+}
+
+bool S98Writer::Open(FILE* stream) {
+    Close();
+    
+    // The image is only written by Finalize, in one pass, so the stream
+    // may be a pipe
+    file = stream;
+    return Open();
+}
+
+bool S98Writer::Open() {
+    if (opened) {
+        Close();
+    }
+    opened = true;
+    
+    // Reserve a placeholder header (will be finalized later)
+    output.assign(GetHeaderSize(), 0);
     WriteHeader();
-    dataStartOffset = ftell(file);
+    dataStartOffset = (uint32_t)output.size();
     currentDataPos = 0;
     
     return true;
 }
 
+bool S98Writer::OpenChunk(const S98Writer& parent) {
+    Close();
+    opened = true;
+    chunk = true;
+    
+    devices = parent.devices;
+    deviceIdMap = parent.deviceIdMap;
+    nextDeviceId = parent.nextDeviceId;
+    return true;
+}
+
+bool S98Writer::AppendChunk(const S98Writer& source) {
+    if (!opened || source.devices.size() != devices.size()) return false;
+    
+    if (source.loopSet && !loopSet) {
+        loopOffset = currentDataPos + source.loopOffset;
+        loopSet = true;
+    }
+    output.insert(output.end(), source.output.begin(), source.output.end());
+    currentDataPos += source.currentDataPos;
+    return true;
+}
+
 void S98Writer::Close() {
-    if (file) {
+    if (opened && !chunk) {
         Finalize();
+    }
+    if (file && ownsFile) {
         fclose(file);
-        file = NULL;
     }
+    file = NULL;
+    ownsFile = false;
+    opened = false;
+    output.clear();
     devices.clear();
     deviceIdMap.clear();
     dataStartOffset = 0;
@@ -39,33 +92,41 @@ void S98Writer::Close() {
     tagOffset = 0;
     currentDataPos = 0;
     loopSet = false;
+    finalized = false;
+    chunk = false;
+    timerNumerator = 1;
+    timerDenominator = 44100;
+    index = NULL;
     nextDeviceId = 0;
 }
 
-void S98Writer::AddDevice(S98DeviceType type, uint32_t clock, uint32_t pan) {
+void S98Writer::AddDevice(S98DeviceType type, uint32_t clock, uint32_t pan, uint8_t instance) {
     // Check if device already exists
-    for (size_t i = 0; i < devices.size(); i++) {
-        if (devices[i].type == type) {
-            return; // Already added
-        }
+    std::pair<S98DeviceType, uint8_t> key(type, instance);
+    if (deviceIdMap.find(key) != deviceIdMap.end()) {
+        return; // Already added
     }
     
     S98Device dev;
     dev.type = type;
     dev.clock = clock;
     dev.pan = pan;
+    dev.instance = instance;
     dev.deviceId = nextDeviceId;
     
     devices.push_back(dev);
-    deviceIdMap[type] = nextDeviceId;
+    deviceIdMap[key] = nextDeviceId;
     
     // Device IDs are assigned in pairs (even numbers)
     nextDeviceId += 2;
 }
 
 void S98Writer::WriteWait(uint32_t ticks) {
-    if (!file) return;
+    if (!opened) return;
     
+    if (ticks > 0 && index) {
+        index->Wait(currentDataPos, ticks);
+    }
     if (ticks == 0) {
         return;
     } else if (ticks == 1) {
@@ -80,36 +141,53 @@ void S98Writer::WriteWait(uint32_t ticks) {
     }
 }
 
+uint32_t S98Writer::GetWaitSize(uint32_t ticks) {
+    if (ticks == 0) {
+        return 0;
+    } else if (ticks == 1) {
+        return 1;
+    }
+    
+    // 0xFE plus a 7-bit-per-byte varint of (ticks - 2)
+    uint32_t size = 2;
+    for (uint32_t v = ticks - 2; v >= 0x80; v >>= 7) {
+        size++;
+    }
+    return size;
+}
+
 void S98Writer::WriteRegister(uint8_t deviceId, uint8_t reg, uint8_t data) {
-    if (!file) return;
+    if (!opened) return;
     
-    WriteUint8(deviceId);
-    WriteUint8(reg);
-    WriteUint8(data);
+    if (index && (size_t)(deviceId >> 1) < devices.size()) {
+        index->Register(devices[deviceId >> 1].type, deviceId, reg, data);
+    }
+    const uint8_t bytes[3] = { deviceId, reg, data };
+    output.insert(output.end(), bytes, bytes + 3);
     currentDataPos += 3;
 }
 
 void S98Writer::WriteEnd() {
-    if (!file) return;
+    if (!opened) return;
     
     WriteUint8(0xFD); // End marker
     currentDataPos++;
 }
 
 void S98Writer::SetLoopPoint() {
-    if (!file || loopSet) return;
+    if (!opened || loopSet) return;
     
     loopOffset = currentDataPos;
     loopSet = true;
 }
 
 void S98Writer::WriteTag(const std::map<std::string, std::string>& tags) {
-    if (!file) return;
+    if (!opened) return;
     
-    tagOffset = ftell(file);
+    tagOffset = (uint32_t)output.size();
     
     // Write S98 v3 tag format: [S98] followed by UTF-8 BOM, then key=value pairs
-    fwrite("[S98]", 1, 5, file);
+    output.insert(output.end(), "[S98]", "[S98]" + 5);
     
     // Write UTF-8 BOM for proper encoding detection
     WriteUint8(0xEF);
@@ -117,100 +195,106 @@ void S98Writer::WriteTag(const std::map<std::string, std::string>& tags) {
     WriteUint8(0xBF);
     
     for (const auto& pair : tags) {
-        std::string line = pair.first + "=" + pair.second + "\n";
-        fwrite(line.c_str(), 1, line.length(), file);
+        output.insert(output.end(), pair.first.begin(), pair.first.end());
+        WriteUint8('=');
+        output.insert(output.end(), pair.second.begin(), pair.second.end());
+        WriteUint8('\n');
     }
     
     // Null terminator
     WriteUint8(0);
 }
 
-void S98Writer::Finalize() {
-    if (!file) return;
+bool S98Writer::Finalize() {
+    if (!opened) return false;
+    if (finalized) return true;
+    finalized = true;
     
-    uint32_t currentFilePos = ftell(file);
+    // Devices added after Open grow the device table; make room for it in
+    // front of the data so the header never overlaps the command stream
+    uint32_t headerSize = GetHeaderSize();
+    if (headerSize > dataStartOffset) {
+        uint32_t growth = headerSize - dataStartOffset;
+        output.insert(output.begin() + dataStartOffset, growth, 0);
+        if (tagOffset > 0) {
+            tagOffset += growth;
+        }
+        dataStartOffset = headerSize;
+    }
     
     // Write header with correct offsets
-    fseek(file, 0, SEEK_SET);
     WriteHeader();
     
     // Update offsets in header
-    fseek(file, 0x14, SEEK_SET); // dataOfs offset
-    WriteUint32(dataStartOffset);
+    PatchUint32(0x14, dataStartOffset); // dataOfs
     
-    fseek(file, 0x18, SEEK_SET); // loopOfs offset
-    if (loopSet && loopOffset > 0) {
-        WriteUint32(dataStartOffset + loopOffset);
+    if (loopSet) {                      // loopOfs (may be the first command)
+        PatchUint32(0x18, dataStartOffset + loopOffset);
     } else {
-        WriteUint32(0);
+        PatchUint32(0x18, 0);
     }
     
-    fseek(file, 0x10, SEEK_SET); // tagOfs offset
-    if (tagOffset > 0) {
-        WriteUint32(tagOffset);
-    } else {
-        WriteUint32(0);
-    }
+    PatchUint32(0x10, tagOffset);       // tagOfs (0 = no tags)
     
-    fseek(file, currentFilePos, SEEK_SET);
+    // Flush the whole image with one large write
+    if (!file) {
+        return true;
+    }
+    return fwrite(output.data(), 1, output.size(), file) == output.size() && fflush(file) == 0;
+}
+
+uint32_t S98Writer::GetHeaderSize() const {
+    // 0x20 fixed fields plus one 16-byte entry per device (at least one)
+    size_t entries = devices.empty() ? 1 : devices.size();
+    return (uint32_t)(0x20 + entries * 16);
 }
 
 void S98Writer::WriteHeader() {
-    if (!file) return;
+    // Write S98 v3 header into the reserved space at the start of the image
+    memcpy(output.data(), "S983", 4); // Magic + version
     
-    // Write S98 v3 header
-    fwrite("S983", 1, 4, file); // Magic + version
-    
-    WriteUint32(1);  // timerNumerator
-    WriteUint32(44100); // timerDenominator (samples per second)
-    WriteUint32(0);  // compression (always 0)
-    WriteUint32(0);  // tagOfs (will be updated in Finalize)
-    WriteUint32(0);  // dataOfs (will be updated in Finalize)
-    WriteUint32(0);  // loopOfs (will be updated in Finalize)
-    WriteUint32((uint32_t)devices.size()); // deviceCount
+    PatchUint32(0x04, timerNumerator);
+    PatchUint32(0x08, timerDenominator);
+    PatchUint32(0x0C, 0);     // compression (always 0)
+    PatchUint32(0x10, 0);     // tagOfs (will be updated in Finalize)
+    PatchUint32(0x14, 0);     // dataOfs (will be updated in Finalize)
+    PatchUint32(0x18, 0);     // loopOfs (will be updated in Finalize)
+    PatchUint32(0x1C, (uint32_t)devices.size()); // deviceCount
     
     // Write device info (0x20 +)
+    uint32_t offset = 0x20;
     for (const auto& dev : devices) {
-        WriteUint32((uint32_t)dev.type);
-        WriteUint32(dev.clock);
-        WriteUint32(dev.pan);
-        WriteUint32(0); // reserved
+        PatchUint32(offset + 0x00, (uint32_t)dev.type);
+        PatchUint32(offset + 0x04, dev.clock);
+        PatchUint32(offset + 0x08, dev.pan);
+        PatchUint32(offset + 0x0C, 0); // reserved
+        offset += 16;
     }
     
     // Pad to 0x20 if no devices (for v0/v1 compatibility)
     if (devices.empty()) {
         // Write default device (OPNA)
-        WriteUint32((uint32_t)S98_DEV_OPNA);
-        WriteUint32(7987200);
-        WriteUint32(0);
-        WriteUint32(0);
+        PatchUint32(offset + 0x00, (uint32_t)S98_DEV_OPNA);
+        PatchUint32(offset + 0x04, 7987200);
+        PatchUint32(offset + 0x08, 0);
+        PatchUint32(offset + 0x0C, 0);
     }
 }
 
-uint8_t S98Writer::GetDeviceId(S98DeviceType type) const {
-    auto it = deviceIdMap.find(type);
+uint8_t S98Writer::GetDeviceId(S98DeviceType type, uint8_t instance) const {
+    auto it = deviceIdMap.find(std::make_pair(type, instance));
     if (it != deviceIdMap.end()) {
         return it->second;
     }
     return 0xFF; // Invalid
 }
 
-void S98Writer::WriteUint8(uint8_t value) {
-    if (file) {
-        fwrite(&value, 1, 1, file);
-    }
-}
-
-void S98Writer::WriteUint16(uint16_t value) {
-    if (file) {
-        fwrite(&value, 1, 2, file);
-    }
-}
-
-void S98Writer::WriteUint32(uint32_t value) {
-    if (file) {
-        fwrite(&value, 1, 4, file);
-    }
+void S98Writer::PatchUint32(uint32_t offset, uint32_t value) {
+    uint8_t* p = &output[offset];
+    p[0] = (uint8_t)(value & 0xFF);
+    p[1] = (uint8_t)((value >> 8) & 0xFF);
+    p[2] = (uint8_t)((value >> 16) & 0xFF);
+    p[3] = (uint8_t)((value >> 24) & 0xFF);
 }
 
 size_t S98Writer::WriteVarInt(uint32_t value) {
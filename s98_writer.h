@@ -6,6 +6,9 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <utility>
+
+class SeekIndexBuilder;
 
 // S98 device types (from s98device.h)
 enum S98DeviceType {
@@ -29,9 +32,10 @@ struct S98Device {
     S98DeviceType type;
     uint32_t clock;
     uint32_t pan;
+    uint8_t instance; // 0 for the first chip of this type, 1 for the second, ...
     uint8_t deviceId; // Internal ID for this device in the S98 file
     
-    S98Device() : type(S98_DEV_NONE), clock(0), pan(0), deviceId(0) {}
+    S98Device() : type(S98_DEV_NONE), clock(0), pan(0), instance(0), deviceId(0) {}
 };
 
 // S98 Writer class
@@ -41,13 +45,37 @@ public:
     ~S98Writer();
     
     bool Open(const char* filename);
+    bool Open(); // Build the file in memory only; fetch it with TakeOutput
+    bool Open(FILE* stream); // Write to a stream the caller owns (e.g. stdout); never seeks
+    
+    // Collect commands only, in memory, for one chunk of a stream that is
+    // encoded in pieces and joined with AppendChunk. The chunk starts with
+    // parent's devices.
+    bool OpenChunk(const S98Writer& parent);
+    
+    // Append a chunk's commands, carrying over its loop point unless one is
+    // set already. Fails, writing nothing, if the chunk added devices.
+    bool AppendChunk(const S98Writer& chunk);
     void Close();
     
-    // Add device (call before writing data)
-    void AddDevice(S98DeviceType type, uint32_t clock, uint32_t pan = 0);
+    // Timer resolution: one tick lasts numerator/denominator seconds. Defaults
+    // to 1/44100 (one VGM sample); reset by Close.
+    void SetTimer(uint32_t numerator, uint32_t denominator) {
+        timerNumerator = numerator;
+        timerDenominator = denominator;
+    }
+    
+    // Feed every sync and register write to index as well (NULL = none);
+    // reset by Close
+    void SetSeekIndex(SeekIndexBuilder* builder) { index = builder; }
+    
+    // Add device (call before writing data). Several chips of one type are
+    // told apart by instance, in the order they appear in the header.
+    void AddDevice(S98DeviceType type, uint32_t clock, uint32_t pan = 0, uint8_t instance = 0);
     
     // Write commands
-    void WriteWait(uint32_t ticks); // ticks = samples (S98 uses 1:1 with samples at 44100Hz)
+    void WriteWait(uint32_t ticks); // In timer ticks (44100 Hz samples unless SetTimer changed it)
+    static uint32_t GetWaitSize(uint32_t ticks); // Bytes WriteWait emits for ticks
     void WriteRegister(uint8_t deviceId, uint8_t reg, uint8_t data);
     void WriteEnd();
     
@@ -57,30 +85,48 @@ public:
     // Write tag data (S98 v3 format)
     void WriteTag(const std::map<std::string, std::string>& tags);
     
-    // Finalize file (write header with correct offsets)
-    void Finalize();
+    // Finalize file (patch header with correct offsets and flush to disk)
+    bool Finalize();
+    
+    bool IsOpen() const { return opened; }
+    uint32_t GetFileSize() const { return (uint32_t)output.size(); }
+    uint32_t GetDataOffset() const { return dataStartOffset; } // Final once Finalize has run
+    
+    // Move the finalized file image out of the writer
+    void TakeOutput(std::vector<uint8_t>& dest) { dest.swap(output); output.clear(); }
     
-    bool IsOpen() const { return file != NULL; }
+    // Get device ID for a chip type and instance (0xFF if not added)
+    uint8_t GetDeviceId(S98DeviceType type, uint8_t instance = 0) const;
     
-    // Get device ID for a chip type
-    uint8_t GetDeviceId(S98DeviceType type) const;
+    // Devices in file order; entry i owns device IDs 2i and 2i+1
+    const std::vector<S98Device>& GetDevices() const { return devices; }
     
 private:
-    FILE* file;
+    FILE* file; // NULL when writing to memory only
+    bool ownsFile; // Opened by name, closed by Close
+    bool opened;
+    // The whole file image is built here and written out by Finalize, so the
+    // header can be patched in memory without seeking the file
+    std::vector<uint8_t> output;
     std::vector<S98Device> devices;
     uint32_t dataStartOffset;
     uint32_t loopOffset;
     uint32_t tagOffset;
     uint32_t currentDataPos;
     bool loopSet;
+    bool finalized;
+    bool chunk; // Commands only, see OpenChunk
+    uint32_t timerNumerator;
+    uint32_t timerDenominator;
+    SeekIndexBuilder* index;
     
-    std::map<S98DeviceType, uint8_t> deviceIdMap;
+    std::map<std::pair<S98DeviceType, uint8_t>, uint8_t> deviceIdMap; // (type, instance) -> ID
     uint8_t nextDeviceId;
     
-    void WriteUint8(uint8_t value);
-    void WriteUint16(uint16_t value);
-    void WriteUint32(uint32_t value);
+    void WriteUint8(uint8_t value) { output.push_back(value); }
+    void PatchUint32(uint32_t offset, uint32_t value);
     void WriteHeader();
+    uint32_t GetHeaderSize() const;
     size_t WriteVarInt(uint32_t value); // Variable-length integer encoding
 };
 
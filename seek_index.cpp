@@ -0,0 +1,66 @@
+#include "seek_index.h"
+#include <string.h>
+
+static const uint32_t kIndexHeaderSize = 0x20;
+static const uint32_t kPortStateSize = 256 + 32;
+
+SeekIndexBuilder::SeekIndexBuilder(uint32_t intervalTicks)
+    : intervalTicks(intervalTicks > 0 ? intervalTicks : 1), tickTime(0), nextKeyframe(0) {
+}
+
+void SeekIndexBuilder::Wait(uint32_t dataPos, uint32_t ticks) {
+    uint64_t end = tickTime + ticks;
+    if (nextKeyframe < end) {
+        // Every keyframe time this sync spans resumes at the sync, with the
+        // state as it is now; one snapshot serves all of them
+        const std::vector<RegisterShadow::PortState>& ports = registers.GetPorts();
+        size_t state = states.size();
+        states.insert(states.end(), ports.begin(), ports.end());
+        do {
+            Keyframe keyframe;
+            keyframe.dataPos = dataPos;
+            keyframe.tick = (uint32_t)tickTime;
+            keyframe.state = state;
+            keyframe.portCount = ports.size();
+            keyframes.push_back(keyframe);
+            nextKeyframe += intervalTicks;
+        } while (nextKeyframe < end);
+    }
+    tickTime = end;
+}
+
+static void StoreUint32(uint8_t* p, uint32_t value) {
+    p[0] = (uint8_t)(value & 0xFF);
+    p[1] = (uint8_t)((value >> 8) & 0xFF);
+    p[2] = (uint8_t)((value >> 16) & 0xFF);
+    p[3] = (uint8_t)((value >> 24) & 0xFF);
+}
+
+void SeekIndexBuilder::Serialize(uint32_t dataStart, uint32_t fileSize, std::vector<uint8_t>& out) const {
+    // Devices added during the song grow the port count; earlier keyframes
+    // have nothing known for them
+    size_t portCount = registers.GetPorts().size();
+    uint32_t keyframeSize = (uint32_t)(8 + portCount * kPortStateSize);
+    out.assign(kIndexHeaderSize + keyframes.size() * keyframeSize, 0);
+    
+    uint8_t* p = out.data();
+    memcpy(p, "S98I", 4);
+    StoreUint32(p + 0x04, 1);
+    StoreUint32(p + 0x08, intervalTicks);
+    StoreUint32(p + 0x0C, (uint32_t)keyframes.size());
+    StoreUint32(p + 0x10, (uint32_t)portCount);
+    StoreUint32(p + 0x14, keyframeSize);
+    StoreUint32(p + 0x18, fileSize);
+    
+    p += kIndexHeaderSize;
+    for (size_t k = 0; k < keyframes.size(); k++, p += keyframeSize) {
+        const Keyframe& keyframe = keyframes[k];
+        StoreUint32(p, dataStart + keyframe.dataPos);
+        StoreUint32(p + 4, keyframe.tick);
+        for (size_t i = 0; i < keyframe.portCount; i++) {
+            const RegisterShadow::PortState& state = states[keyframe.state + i];
+            memcpy(p + 8 + i * kPortStateSize, state.regs, 256);
+            memcpy(p + 8 + i * kPortStateSize + 256, state.known, 32);
+        }
+    }
+}
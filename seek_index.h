@@ -0,0 +1,70 @@
+#ifndef SEEK_INDEX_H
+#define SEEK_INDEX_H
+
+#include <stdint.h>
+#include <vector>
+#include "register_shadow.h"
+
+// Seek index sidecar for an S98 file: a keyframe every interval ticks with
+// the file offset to resume at and the state of every register written so
+// far, so a player can jump to any time in O(1) and replay only the short
+// tail up to it instead of the whole song.
+//
+// Layout (little-endian, every field 4-byte aligned so the file can be
+// mapped and read in place):
+//
+//   0x00  "S98I"
+//   0x04  version (1)
+//   0x08  keyframe interval, in S98 ticks
+//   0x0C  keyframe count
+//   0x10  port count (S98 device IDs, two per device)
+//   0x14  keyframe size in bytes
+//   0x18  size of the S98 file the index belongs to
+//   0x1C  reserved (0)
+//   0x20  keyframes
+//
+// Keyframe k describes time k * interval ticks:
+//
+//   +0x00  file offset of the command to resume at (always a sync)
+//   +0x04  tick time at that offset, at most k * interval; the sync there
+//          spans the rest of the way
+//   +0x08  per port: 256 register values, then a 32-byte mask with bit r
+//          set when register r has been written
+//
+// SN76489 ports hold the shadow's channel layout (see RegisterShadow).
+// Keyframes cover the data as written, up to the last sync; after the end
+// playback continues at the S98 loop point.
+class SeekIndexBuilder {
+public:
+    explicit SeekIndexBuilder(uint32_t intervalTicks);
+    
+    // Called by S98Writer for every register write and sync it emits.
+    // dataPos is the offset of the sync in the data, before it is written.
+    void Register(S98DeviceType type, uint8_t deviceId, uint8_t reg, uint8_t data) {
+        registers.Write(type, deviceId, reg, data);
+    }
+    void Wait(uint32_t dataPos, uint32_t ticks);
+    
+    uint32_t GetKeyframeCount() const { return (uint32_t)keyframes.size(); }
+    
+    // Lay out the sidecar; dataStart is the S98 data offset, fileSize the
+    // size of the finalized S98 file
+    void Serialize(uint32_t dataStart, uint32_t fileSize, std::vector<uint8_t>& out) const;
+    
+private:
+    struct Keyframe {
+        uint32_t dataPos;
+        uint32_t tick;
+        size_t state; // First port of this keyframe in states
+        size_t portCount;
+    };
+    
+    uint32_t intervalTicks;
+    uint64_t tickTime;     // Ticks written so far
+    uint64_t nextKeyframe; // Tick time of the next keyframe
+    RegisterShadow registers; // Never invalidated: the state as played
+    std::vector<Keyframe> keyframes;
+    std::vector<RegisterShadow::PortState> states; // Snapshots, in keyframe order
+};
+
+#endif // SEEK_INDEX_H
@@ -0,0 +1,86 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. Capacity is rounded up to a power of two.
+//
+// Both sides publish their index in batches rather than per item, and keep
+// a private copy of the other side's index that is only refreshed when the
+// copy says the ring is full (or empty). The two threads therefore touch
+// each other's cache line a few times per batch instead of per item. The
+// producer must call Flush() before it waits and after its last item; the
+// consumer releases its slots by itself whenever it runs dry.
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable: 4324) // Padded for alignas(64), which is the point
+#endif
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity, size_t batch = 64)
+        : head(0), localHead(0), cachedTail(0), tail(0), localTail(0), cachedHead(0) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        slots.resize(size);
+        mask = size - 1;
+        batchMask = 1;
+        while (batchMask < batch && batchMask < size / 2) batchMask <<= 1;
+        batchMask--;
+    }
+
+    // Producer side. Returns false if the ring is full.
+    bool TryPush(const T& item) {
+        if (localTail - cachedHead > mask) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (localTail - cachedHead > mask) return false;
+        }
+        slots[localTail & mask] = item;
+        localTail++;
+        if ((localTail & batchMask) == 0) {
+            tail.store(localTail, std::memory_order_release);
+        }
+        return true;
+    }
+
+    // Producer side: make every pushed item visible to the consumer
+    void Flush() { tail.store(localTail, std::memory_order_release); }
+
+    // Consumer side. Returns false if no published item is available.
+    bool TryPop(T& item) {
+        if (localHead == cachedTail) {
+            head.store(localHead, std::memory_order_release);
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (localHead == cachedTail) return false;
+        }
+        item = slots[localHead & mask];
+        localHead++;
+        if ((localHead & batchMask) == 0) {
+            head.store(localHead, std::memory_order_release);
+        }
+        return true;
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask;
+    size_t batchMask;
+
+    // Consumer-owned line
+    alignas(64) std::atomic<size_t> head;
+    size_t localHead;
+    size_t cachedTail;
+
+    // Producer-owned line
+    alignas(64) std::atomic<size_t> tail;
+    size_t localTail;
+    size_t cachedHead;
+};
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif // SPSC_RING_H
@@ -0,0 +1,114 @@
+#include "stats_json.h"
+#include <stdint.h>
+
+static const char* GetDeviceName(S98DeviceType type) {
+    switch (type) {
+        case S98_DEV_PSG: return "PSG";
+        case S98_DEV_OPN: return "OPN";
+        case S98_DEV_OPN2: return "OPN2";
+        case S98_DEV_OPNA: return "OPNA";
+        case S98_DEV_OPM: return "OPM";
+        case S98_DEV_OPLL: return "OPLL";
+        case S98_DEV_OPL: return "OPL";
+        case S98_DEV_OPL2: return "OPL2";
+        case S98_DEV_OPL3: return "OPL3";
+        case S98_DEV_MSXA: return "MSXA";
+        case S98_DEV_AY8910: return "AY8910";
+        case S98_DEV_SN76489: return "SN76489";
+        default: return "NONE";
+    }
+}
+
+// Quote a string; bytes above 0x7F pass through as they are (UTF-8 paths)
+static void WriteString(FILE* out, const char* s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fputc('\\', out);
+            fputc(c, out);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+void WriteStatsJSON(FILE* out, const char* input, const char* output, bool ok,
+                    const ConversionSummary& summary) {
+    fputs("{\"input\":", out);
+    WriteString(out, input ? input : "");
+    fputs(",\"output\":", out);
+    WriteString(out, output ? output : "");
+    fprintf(out, ",\"ok\":%s,\"cached\":%s", ok ? "true" : "false", summary.cached ? "true" : "false");
+    if (!ok) {
+        fputs(",\"error\":", out);
+        WriteString(out, summary.error.c_str());
+        fputs("}\n", out);
+        return;
+    }
+    
+    // Sizes
+    fprintf(out, ",\"bytes\":{\"in\":%u,\"out\":%u,\"ratio\":", summary.inputBytes, summary.outputBytes);
+    if (summary.inputBytes > 0) {
+        fprintf(out, "%.4f}", (double)summary.outputBytes / summary.inputBytes);
+    } else {
+        fputs("null}", out);
+    }
+    
+    fprintf(out, ",\"samples\":%u", summary.totalSamples);
+    fprintf(out, ",\"timer\":{\"numerator\":%u,\"denominator\":%u,\"maxErrorSamples\":%.2f}",
+            summary.timerNumerator, summary.timerDenominator, summary.maxTimingError);
+    
+    fprintf(out, ",\"commands\":{\"registerWrites\":%u,\"waits\":%u,\"unknown\":%u,\"dacWrites\":%u,"
+            "\"droppedWrites\":%u,\"waitBytesSaved\":%u}", summary.registerWrites, summary.waitCommands,
+            summary.unknownCommands, summary.dacWrites, summary.registerWritesDropped, summary.waitBytesSaved);
+    
+    // Histogram by opcode byte as stored in the VGM, zero counts left out
+    fputs(",\"opcodes\":{", out);
+    bool first = true;
+    for (size_t i = 0; i < summary.opcodeCounts.size(); i++) {
+        if (summary.opcodeCounts[i] == 0) continue;
+        fprintf(out, "%s\"0x%02X\":%u", first ? "" : ",", (unsigned)i, summary.opcodeCounts[i]);
+        first = false;
+    }
+    fputc('}', out);
+    
+    // Register writes by S98 device, in device order
+    fputs(",\"devices\":[", out);
+    for (size_t i = 0; i < summary.devices.size(); i++) {
+        const DeviceWriteCount& device = summary.devices[i];
+        fprintf(out, "%s{\"type\":\"%s\",\"instance\":%u,\"clock\":%u,\"writes\":%u}", i ? "," : "",
+                GetDeviceName(device.type), (unsigned)device.instance, device.clock, device.writes);
+    }
+    fputc(']', out);
+    
+    fprintf(out, ",\"seekKeyframes\":%u", summary.seekKeyframes);
+    
+    fprintf(out, ",\"skippedDataBlocks\":{\"count\":%u,\"bytes\":%u}",
+            summary.skippedDataBlocks, summary.skippedDataBytes);
+    
+    fprintf(out, ",\"timing\":{\"decodeSeconds\":%.6f,\"encodeSeconds\":%.6f,\"tagSeconds\":%.6f,"
+            "\"pipelined\":%s,\"decodeStalls\":%llu,\"encodeStalls\":%llu,\"chunks\":%u}",
+            summary.decodeSeconds, summary.encodeSeconds, summary.tagSeconds, summary.pipelined ? "true" : "false",
+            (unsigned long long)summary.decodeStalls, (unsigned long long)summary.encodeStalls, summary.chunks);
+    
+    // Loop placement against the header: the loop should start loopSamples
+    // before the end of the song
+    fprintf(out, ",\"loop\":{\"set\":%s,\"detected\":%s", summary.loopSet ? "true" : "false",
+            summary.loopDetected ? "true" : "false");
+    if (summary.loopSet) {
+        uint32_t length = summary.totalSamples - summary.loopStartSamples;
+        fprintf(out, ",\"startSamples\":%u,\"lengthSamples\":%u", summary.loopStartSamples, length);
+        if (summary.headerLoopSamples > 0) {
+            int64_t headerStart = (int64_t)summary.headerTotalSamples - summary.headerLoopSamples;
+            fprintf(out, ",\"headerStartSamples\":%lld,\"headerLengthSamples\":%u,"
+                    "\"startError\":%lld,\"lengthError\":%lld", (long long)headerStart,
+                    summary.headerLoopSamples, (long long)(summary.loopStartSamples - headerStart),
+                    (long long)((int64_t)length - summary.headerLoopSamples));
+        }
+    }
+    fputs("}}\n", out);
+}
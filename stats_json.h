@@ -0,0 +1,13 @@
+#ifndef STATS_JSON_H
+#define STATS_JSON_H
+
+#include <stdio.h>
+#include "converter.h"
+
+// Write the statistics of one conversion as a single-line JSON object, so a
+// batch run produces JSON Lines. When ok is false only the error and the
+// paths are meaningful.
+void WriteStatsJSON(FILE* out, const char* input, const char* output, bool ok,
+                    const ConversionSummary& summary);
+
+#endif // STATS_JSON_H
@@ -0,0 +1,61 @@
+# Converts the benchmark corpus serially, with --parallel, with --pipeline
+# and through stdin/stdout, requires the four S98 files to be identical and
+# checks the serial one with --verify. Run by ctest as
+#   cmake -DVGM2S98=<exe> -DBENCH=<exe> -DWORK_DIR=<dir> -P cli_equivalence.cmake
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+
+# 2 MB per file: enough for --parallel to split every corpus
+execute_process(COMMAND "${BENCH}" --write-corpus "${WORK_DIR}" --size 2 --iterations 1
+                RESULT_VARIABLE result OUTPUT_QUIET)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "vgm2s98_bench --write-corpus failed")
+endif()
+
+file(GLOB corpus "${WORK_DIR}/*.vgm")
+list(LENGTH corpus count)
+if(count EQUAL 0)
+    message(FATAL_ERROR "No corpus files written to ${WORK_DIR}")
+endif()
+
+foreach(vgm ${corpus})
+    get_filename_component(name "${vgm}" NAME_WE)
+    set(out "${WORK_DIR}/${name}")
+
+    execute_process(COMMAND "${VGM2S98}" "${vgm}" "${out}.s98"
+                    RESULT_VARIABLE result OUTPUT_QUIET ERROR_QUIET)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${name}: serial conversion failed")
+    endif()
+    execute_process(COMMAND "${VGM2S98}" --parallel=4 "${vgm}" "${out}.parallel.s98"
+                    RESULT_VARIABLE result OUTPUT_VARIABLE log ERROR_VARIABLE log)
+    if(NOT result EQUAL 0 OR NOT log MATCHES "Encoded in [0-9]+ chunks")
+        message(FATAL_ERROR "${name}: --parallel conversion failed or ran serially")
+    endif()
+    execute_process(COMMAND "${VGM2S98}" --pipeline "${vgm}" "${out}.pipeline.s98"
+                    RESULT_VARIABLE result OUTPUT_QUIET ERROR_QUIET)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${name}: --pipeline conversion failed")
+    endif()
+    execute_process(COMMAND "${VGM2S98}" - - INPUT_FILE "${vgm}" OUTPUT_FILE "${out}.stream.s98"
+                    RESULT_VARIABLE result ERROR_QUIET)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${name}: conversion from stdin to stdout failed")
+    endif()
+
+    foreach(mode parallel pipeline stream)
+        execute_process(COMMAND "${CMAKE_COMMAND}" -E compare_files "${out}.s98" "${out}.${mode}.s98"
+                        RESULT_VARIABLE result)
+        if(NOT result EQUAL 0)
+            message(FATAL_ERROR "${name}: ${mode} output differs from the serial conversion")
+        endif()
+    endforeach()
+
+    execute_process(COMMAND "${VGM2S98}" --verify "${vgm}" "${out}.s98"
+                    RESULT_VARIABLE result OUTPUT_VARIABLE log ERROR_VARIABLE log)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${name}: --verify failed:\n${log}")
+    endif()
+    message(STATUS "${name}: serial, --parallel, --pipeline and - - identical; verified")
+endforeach()
@@ -0,0 +1,236 @@
+// Regression tests run by ctest on generated VGMs:
+//   opcodes  every opcode decodes with its VGM spec length, in both the
+//            decoder and the chunk pre-scan
+//   loops    the S98 loop point lands on the VGM loop command's time,
+//            also between two waits that would otherwise be coalesced
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include "converter.h"
+#include "vgm_reader.h"
+#include "s98_reader.h"
+#include "verifier.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+static const uint32_t kDataStart = 0x40;
+
+static void StoreUint32(std::vector<uint8_t>& image, size_t offset, uint32_t value) {
+    image[offset] = (uint8_t)(value & 0xFF);
+    image[offset + 1] = (uint8_t)((value >> 8) & 0xFF);
+    image[offset + 2] = (uint8_t)((value >> 16) & 0xFF);
+    image[offset + 3] = (uint8_t)((value >> 24) & 0xFF);
+}
+
+// VGM 1.50 image with a YM2612 and the data at 0x40. loopCommand is an
+// absolute offset (0 = no loop).
+static std::vector<uint8_t> MakeVGM(const std::vector<uint8_t>& data, uint32_t totalSamples,
+                                    uint32_t loopCommand, uint32_t loopSamples) {
+    std::vector<uint8_t> image(kDataStart + data.size(), 0);
+    std::copy(data.begin(), data.end(), image.begin() + kDataStart);
+    memcpy(image.data(), "Vgm ", 4);
+    StoreUint32(image, 0x04, (uint32_t)image.size() - 4);
+    StoreUint32(image, 0x08, 0x150);
+    StoreUint32(image, 0x18, totalSamples);
+    StoreUint32(image, 0x1C, loopCommand ? loopCommand - 0x1C : 0);
+    StoreUint32(image, 0x20, loopCommand ? loopSamples : 0);
+    StoreUint32(image, 0x2C, 7670453);
+    StoreUint32(image, 0x34, kDataStart - 0x34);
+    return image;
+}
+
+// Command lengths from the VGM 1.71 spec, written out independently of the
+// reader's opcode table (0x67 is handled by the caller)
+static uint32_t SpecLength(unsigned op) {
+    if (op >= 0x30 && op <= 0x3F) return 2;
+    if (op >= 0x40 && op <= 0x4E) return 3;
+    if (op == 0x4F || op == 0x50) return 2;
+    if (op >= 0x51 && op <= 0x5F) return 3;
+    if (op == 0x61) return 3;
+    if (op == 0x64) return 4;
+    if (op == 0x68) return 12;
+    if (op == 0x90 || op == 0x91 || op == 0x95) return 5;
+    if (op == 0x92) return 6;
+    if (op == 0x93) return 11;
+    if (op == 0x94) return 2;
+    if (op >= 0xA0 && op <= 0xBF) return 3;
+    if (op >= 0xC0 && op <= 0xDF) return 4;
+    if (op >= 0xE0) return 5;
+    return 1; // Waits, DAC writes, 0x66 and undefined opcodes
+}
+
+static uint32_t SpecWait(unsigned op) {
+    if (op == 0x62) return 735;
+    if (op == 0x63) return 882;
+    if (op >= 0x70 && op <= 0x7F) return op - 0x6F;
+    if (op >= 0x80 && op <= 0x8F) return op - 0x80;
+    return 0; // 0x61 carries its own length, 0 here
+}
+
+// One command per opcode, operands zero, in opcode order, then the end
+static bool TestOpcodes() {
+    std::vector<uint8_t> data;
+    std::vector<uint32_t> offsets;
+    std::vector<uint64_t> times;
+    uint64_t samples = 0;
+    for (unsigned op = 0; op < 256; op++) {
+        if (op == 0x66) continue;
+        offsets.push_back(kDataStart + (uint32_t)data.size());
+        times.push_back(samples);
+        data.push_back((uint8_t)op);
+        if (op == 0x67) {
+            // 0x67 0x66 tt ss ss ss ss, then a 4-byte payload
+            const uint8_t block[] = { 0x66, 0x00, 0x04, 0x00, 0x00, 0x00, 1, 2, 3, 4 };
+            data.insert(data.end(), block, block + sizeof(block));
+        } else {
+            data.insert(data.end(), SpecLength(op) - 1, 0);
+        }
+        samples += SpecWait(op);
+    }
+    offsets.push_back(kDataStart + (uint32_t)data.size());
+    times.push_back(samples);
+    data.push_back(0x66);
+    std::vector<uint8_t> image = MakeVGM(data, (uint32_t)samples, 0, 0);
+    
+    VGMReader reader;
+    VGMHeader header;
+    CHECK(reader.Open(image.data(), image.size()) && reader.ReadHeader(header), "opening the opcode VGM");
+    VGMCommand cmd;
+    size_t count = 0;
+    while (count < offsets.size() && reader.ReadNextCommand(cmd)) {
+        CHECK(cmd.offset == offsets[count], "decoder: command %u at 0x%X, expected 0x%X (after opcode 0x%02X)",
+              (unsigned)count, cmd.offset, offsets[count], count > 0 ? image[offsets[count - 1]] : 0);
+        if (cmd.offset != offsets[count]) break;
+        count++;
+        if (cmd.kind == VGM_KIND_END) break;
+    }
+    CHECK(count == offsets.size(), "decoder: %u of %u commands decoded", (unsigned)count,
+          (unsigned)offsets.size());
+    
+    // With one-byte chunks every command starts a chunk
+    std::vector<VGMChunk> chunks;
+    uint32_t loopCommand;
+    CHECK(reader.ScanChunks(1, 0, chunks, loopCommand), "pre-scan of the opcode VGM");
+    CHECK(chunks.size() == offsets.size(), "pre-scan: %u chunks, expected %u", (unsigned)chunks.size(),
+          (unsigned)offsets.size());
+    for (size_t k = 0; k < chunks.size() && k < offsets.size(); k++) {
+        if (chunks[k].offset != offsets[k] || chunks[k].samples != times[k]) {
+            CHECK(false, "pre-scan: chunk %u at 0x%X (%u samples), expected 0x%X (%u samples)", (unsigned)k,
+                  chunks[k].offset, (unsigned)chunks[k].samples, offsets[k], (unsigned)times[k]);
+            break;
+        }
+    }
+    return failures == 0;
+}
+
+struct LoopCase {
+    const char* name;
+    uint32_t loopCommand; // Absolute VGM offset
+    uint32_t loopSamples; // Expected sample time of the S98 loop point
+};
+
+static bool TestLoops() {
+    // Sample time of each command in brackets
+    const uint8_t data[] = {
+        0x52, 0x22, 0x00, // 0x40 [0]   write
+        0x61, 0x10, 0x00, // 0x43 [0]   wait 16
+        0x62,             // 0x46 [16]  wait 735
+        0x52, 0x28, 0xF0, // 0x47 [751] write
+        0x7F,             // 0x4A [751] wait 16
+        0x70,             // 0x4B [767] wait 1
+        0x66,             // 0x4C [768]
+    };
+    const uint32_t totalSamples = 768;
+    const LoopCase cases[] = {
+        { "first command", 0x40, 0 },
+        { "between two waits", 0x46, 16 },
+        { "write after waits", 0x47, 751 },
+        { "last wait", 0x4B, 767 },
+        { "inside a command", 0x44, 16 }, // Moves to the next command
+    };
+    
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        const LoopCase& loop = cases[c];
+        std::vector<uint8_t> vgm = MakeVGM(std::vector<uint8_t>(data, data + sizeof(data)), totalSamples,
+                                           loop.loopCommand, totalSamples - loop.loopSamples);
+        std::vector<uint8_t> serial;
+        for (int mode = 0; mode < 4; mode++) {
+            static const char* const kModes[] = { "serial", "--no-coalesce", "--pipeline", "--optimize-regs" };
+            ConvertOptions options;
+            options.verifyLoop = true;
+            options.coalesceWaits = mode != 1;
+            options.pipeline = mode == 2;
+            options.optimizeRegisters = mode == 3;
+            
+            std::vector<uint8_t> s98;
+            ConversionSummary summary;
+            if (!Convert(vgm.data(), vgm.size(), s98, options, &summary)) {
+                CHECK(false, "%s, %s: conversion failed: %s", loop.name, kModes[mode], summary.error.c_str());
+                continue;
+            }
+            CHECK(summary.loopSet && summary.loopStartSamples == loop.loopSamples,
+                  "%s, %s: loop at %u samples, expected %u", loop.name, kModes[mode], summary.loopStartSamples,
+                  loop.loopSamples);
+            if (mode == 0) {
+                serial = s98;
+            } else if (mode == 2) {
+                CHECK(s98 == serial, "%s: --pipeline output differs from serial", loop.name);
+            }
+            
+            // The loop offset must be a command boundary at the loop's tick
+            S98Reader reader;
+            S98Header header;
+            CHECK(reader.Open(s98.data(), s98.size()) && reader.ReadHeader(header), "%s, %s: reading the S98",
+                  loop.name, kModes[mode]);
+            uint64_t ticks = 0;
+            bool atLoop = false;
+            S98Command cmd;
+            while (reader.ReadNextCommand(cmd) && cmd.kind != S98_CMD_END) {
+                if (cmd.offset == header.loopOffset) {
+                    CHECK(ticks == loop.loopSamples, "%s, %s: loop offset at tick %u, expected %u", loop.name,
+                          kModes[mode], (unsigned)ticks, loop.loopSamples);
+                    atLoop = true;
+                }
+                if (cmd.kind == S98_CMD_WAIT) ticks += cmd.ticks;
+            }
+            CHECK(atLoop, "%s, %s: loop offset 0x%X is not a command", loop.name, kModes[mode], header.loopOffset);
+            CHECK(ticks == totalSamples, "%s, %s: %u ticks, expected %u", loop.name, kModes[mode],
+                  (unsigned)ticks, totalSamples);
+            
+            VGMReader vgmReader;
+            VerifyReport report;
+            CHECK(vgmReader.Open(vgm.data(), vgm.size()) && VerifyConversion(vgmReader, reader, options, &report),
+                  "%s, %s: verification failed: %s", loop.name, kModes[mode], report.error.c_str());
+        }
+    }
+    return failures == 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <opcodes|loops>\n", argv[0]);
+        return 2;
+    }
+    bool ok;
+    if (strcmp(argv[1], "opcodes") == 0) {
+        ok = TestOpcodes();
+    } else if (strcmp(argv[1], "loops") == 0) {
+        ok = TestLoops();
+    } else {
+        fprintf(stderr, "Unknown test: %s\n", argv[1]);
+        return 2;
+    }
+    printf("%s: %s\n", argv[1], ok ? "passed" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,362 @@
+#include "verifier.h"
+#include "register_shadow.h"
+#include "loop_detector.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <vector>
+#include <map>
+
+// One register write at its S98 tick
+struct TimedWrite {
+    uint64_t tick;
+    uint8_t deviceId;
+    uint8_t reg;
+    uint8_t data;
+    bool optional; // Could not change chip state, so the S98 may leave it out
+};
+
+// DAC expansion writes YM2612 register 0x2A on port 0
+static bool IsDACWrite(S98DeviceType type, uint8_t port, uint8_t reg) {
+    return type == S98_DEV_OPN2 && port == 0 && reg == 0x2A;
+}
+
+// Sample time -> tick, rounded the way WaitCoalescer places events
+class TickClock {
+public:
+    explicit TickClock(const S98Header& header)
+        : ticksPerSampleNum(header.timerDenominator),
+          ticksPerSampleDen((uint64_t)header.timerNumerator * 44100) {}
+    
+    uint64_t ToTick(uint64_t samples) const {
+        if (ticksPerSampleNum == ticksPerSampleDen) return samples;
+        return (samples * ticksPerSampleNum + ticksPerSampleDen / 2) / ticksPerSampleDen;
+    }
+    uint32_t ToSamples(uint64_t tick) const {
+        return (uint32_t)(tick * ticksPerSampleDen / ticksPerSampleNum);
+    }
+    
+private:
+    uint64_t ticksPerSampleNum;
+    uint64_t ticksPerSampleDen;
+};
+
+// Register writes of the VGM, mapped to the S98's device IDs
+class VGMWriteSource {
+public:
+    VGMWriteSource(VGMReader& reader, const VGMHeader& vgmHeader, const S98Header& s98Header,
+                   const TickClock& clock, bool ignoreDAC, uint32_t loopOffset, uint32_t endOffset,
+                   VerifyReport& report)
+        : reader(reader), clock(clock), ignoreDAC(ignoreDAC), report(report),
+          loopOffset(loopOffset), endOffset(endOffset), samples(0), loopReached(false), loopTick(0),
+          endTick(0) {
+        GetS98Instances(vgmHeader, firstInstance);
+        for (size_t i = 0; i < s98Header.devices.size(); i++) {
+            const S98Device& dev = s98Header.devices[i];
+            deviceIds[std::make_pair(dev.type, dev.instance)] = (uint8_t)(i * 2);
+        }
+    }
+    
+    bool Next(TimedWrite& write) {
+        VGMCommand cmd;
+        while (reader.ReadNextCommand(cmd)) {
+            // The converter places the loop at the first command at or past
+            // the loop offset, with end-of-song register state
+            if (!loopReached && loopOffset > 0 && cmd.offset >= loopOffset) {
+                loopReached = true;
+                loopTick = clock.ToTick(samples);
+                shadow.Invalidate();
+            }
+            if (cmd.kind == VGM_KIND_END || (endOffset > 0 && cmd.offset >= endOffset)) {
+                break;
+            }
+            if (cmd.kind != VGM_KIND_WRITE) {
+                samples += cmd.waitSamples;
+                continue;
+            }
+    
+            if (cmd.chip == kVGMChipNone) {
+                continue; // No S98 equivalent (e.g. Game Gear stereo)
+            }
+            S98DeviceType type = kVGMChips[cmd.chip].s98Type;
+            std::map<std::pair<S98DeviceType, uint8_t>, uint8_t>::const_iterator it =
+                deviceIds.find(std::make_pair(type, (uint8_t)(firstInstance[cmd.chip] + cmd.instance)));
+            if (it == deviceIds.end()) {
+                report.writesUnmapped++;
+                continue;
+            }
+            if (ignoreDAC && IsDACWrite(type, cmd.port, cmd.reg)) {
+                report.dacWritesIgnored++;
+                continue;
+            }
+    
+            write.tick = clock.ToTick(samples);
+            write.deviceId = (uint8_t)(it->second + cmd.port);
+            write.reg = cmd.reg;
+            write.data = cmd.data;
+            write.optional = !shadow.Write(type, write.deviceId, cmd.reg, cmd.data);
+            return true;
+        }
+        endTick = clock.ToTick(samples);
+        return false;
+    }
+    
+    bool GetLoopTick(uint64_t& tick) const { tick = loopTick; return loopReached; }
+    uint64_t GetEndTick() const { return endTick; }
+    
+private:
+    VGMReader& reader;
+    const TickClock& clock;
+    bool ignoreDAC;
+    VerifyReport& report;
+    uint32_t loopOffset;
+    uint32_t endOffset; // Where a detected loop cuts the data (0 = at the end)
+    uint64_t samples;
+    bool loopReached;
+    uint64_t loopTick;
+    uint64_t endTick;
+    RegisterShadow shadow;
+    uint8_t firstInstance[kVGMChipCount]; // S98 instance of each chip, as the converter numbers them
+    std::map<std::pair<S98DeviceType, uint8_t>, uint8_t> deviceIds; // (type, instance) -> base ID
+};
+
+// Register writes of the S98
+class S98WriteSource {
+public:
+    S98WriteSource(S98Reader& reader, const S98Header& header, bool ignoreDAC, VerifyReport& report)
+        : reader(reader), header(header), ignoreDAC(ignoreDAC), report(report),
+          ticks(0), loopReached(false), loopTick(0), endTick(0) {}
+    
+    bool Next(TimedWrite& write) {
+        S98Command cmd;
+        while (reader.ReadNextCommand(cmd)) {
+            if (!loopReached && header.loopOffset > 0 && cmd.offset >= header.loopOffset) {
+                loopReached = true;
+                loopTick = ticks;
+            }
+            if (cmd.kind == S98_CMD_END) {
+                break;
+            }
+            if (cmd.kind == S98_CMD_WAIT) {
+                ticks += cmd.ticks;
+                continue;
+            }
+    
+            size_t entry = cmd.deviceId / 2;
+            if (ignoreDAC && entry < header.devices.size() &&
+                IsDACWrite(header.devices[entry].type, cmd.deviceId & 1, cmd.reg)) {
+                report.dacWritesIgnored++;
+                continue;
+            }
+            write.tick = ticks;
+            write.deviceId = cmd.deviceId;
+            write.reg = cmd.reg;
+            write.data = cmd.data;
+            write.optional = false;
+            return true;
+        }
+        endTick = ticks;
+        return false;
+    }
+    
+    bool GetLoopTick(uint64_t& tick) const { tick = loopTick; return loopReached; }
+    uint64_t GetEndTick() const { return endTick; }
+    
+private:
+    S98Reader& reader;
+    const S98Header& header;
+    bool ignoreDAC;
+    VerifyReport& report;
+    uint64_t ticks;
+    bool loopReached;
+    uint64_t loopTick;
+    uint64_t endTick;
+};
+
+static void SetMismatch(VerifyReport& report, uint32_t samples, const char* format, ...) {
+    char text[192];
+    int n = snprintf(text, sizeof(text), "At %u samples: ", samples);
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text + n, sizeof(text) - n, format, args);
+    va_end(args);
+    report.error = text;
+    report.mismatchSamples = samples;
+}
+
+// Compare the writes of one tick device by device. Within a device ID the
+// order must match; VGM writes that could not change chip state may be
+// missing from the S98.
+static bool CompareTick(const std::vector<TimedWrite>& vgm, const std::vector<TimedWrite>& s98,
+                        uint32_t samples, VerifyReport& report) {
+    // Usual case: the converter kept every write in order
+    if (vgm.size() == s98.size()) {
+        size_t i = 0;
+        while (i < vgm.size() && vgm[i].deviceId == s98[i].deviceId && vgm[i].reg == s98[i].reg &&
+               vgm[i].data == s98[i].data) {
+            i++;
+        }
+        if (i == vgm.size()) {
+            report.writesMatched += i;
+            return true;
+        }
+    }
+    
+    bool present[256] = { false };
+    std::vector<uint8_t> ids;
+    for (size_t i = 0; i < vgm.size(); i++) {
+        if (!present[vgm[i].deviceId]) ids.push_back(vgm[i].deviceId);
+        present[vgm[i].deviceId] = true;
+    }
+    for (size_t i = 0; i < s98.size(); i++) {
+        if (!present[s98[i].deviceId]) ids.push_back(s98[i].deviceId);
+        present[s98[i].deviceId] = true;
+    }
+    
+    for (size_t k = 0; k < ids.size(); k++) {
+        unsigned id = ids[k];
+        size_t v = 0;
+        size_t s = 0;
+        for (;;) {
+            while (v < vgm.size() && vgm[v].deviceId != id) v++;
+            while (s < s98.size() && s98[s].deviceId != id) s++;
+            if (s == s98.size()) break;
+            if (v == vgm.size()) {
+                SetMismatch(report, samples, "device %u: unexpected write reg 0x%02X = 0x%02X",
+                            id, s98[s].reg, s98[s].data);
+                return false;
+            }
+            if (vgm[v].reg == s98[s].reg && vgm[v].data == s98[s].data) {
+                report.writesMatched++;
+                v++;
+                s++;
+            } else if (vgm[v].optional) {
+                report.writesRedundant++;
+                v++;
+            } else {
+                SetMismatch(report, samples, "device %u: expected reg 0x%02X = 0x%02X, found reg 0x%02X = 0x%02X",
+                            id, vgm[v].reg, vgm[v].data, s98[s].reg, s98[s].data);
+                return false;
+            }
+        }
+        // What is left on the VGM side must be droppable
+        for (; v < vgm.size(); v++) {
+            if (vgm[v].deviceId != id) continue;
+            if (!vgm[v].optional) {
+                SetMismatch(report, samples, "device %u: missing write reg 0x%02X = 0x%02X",
+                            id, vgm[v].reg, vgm[v].data);
+                return false;
+            }
+            report.writesRedundant++;
+        }
+    }
+    return true;
+}
+
+bool VerifyConversion(VGMReader& vgm, S98Reader& s98, const ConvertOptions& options, VerifyReport* report) {
+    VerifyReport local;
+    if (!report) report = &local;
+    
+    VGMHeader vgmHeader;
+    if (!vgm.ReadHeader(vgmHeader)) {
+        report->error = "Invalid VGM file";
+        return false;
+    }
+    S98Header s98Header;
+    if (!s98.ReadHeader(s98Header)) {
+        report->error = "Invalid or unsupported S98 file (v3 only)";
+        return false;
+    }
+    if (s98Header.timerNumerator == 0 || s98Header.timerDenominator == 0 || s98Header.compression != 0) {
+        report->error = "Unsupported S98 timer or compression";
+        return false;
+    }
+    
+    // With options.detectLoop the converter may have cut the VGM short;
+    // the detection is repeated to find the same cut
+    uint32_t loopOffset = vgm.GetLoopOffset();
+    uint32_t endOffset = 0;
+    LoopMatch match;
+    if (loopOffset == 0 && options.detectLoop && !options.expandDAC && DetectLoop(vgm, match)) {
+        loopOffset = match.loopOffset;
+        endOffset = match.endOffset;
+    }
+    
+    TickClock clock(s98Header);
+    VGMWriteSource vgmWrites(vgm, vgmHeader, s98Header, clock, options.expandDAC, loopOffset, endOffset, *report);
+    S98WriteSource s98Writes(s98, s98Header, options.expandDAC, *report);
+    
+    // Walk both streams one tick at a time
+    TimedWrite v;
+    TimedWrite s;
+    bool haveVGM = vgmWrites.Next(v);
+    bool haveS98 = s98Writes.Next(s);
+    std::vector<TimedWrite> vgmTick;
+    std::vector<TimedWrite> s98Tick;
+    while (haveVGM || haveS98) {
+        uint64_t tick = !haveS98 || (haveVGM && v.tick < s.tick) ? v.tick : s.tick;
+        vgmTick.clear();
+        s98Tick.clear();
+        while (haveVGM && v.tick == tick) {
+            vgmTick.push_back(v);
+            haveVGM = vgmWrites.Next(v);
+        }
+        while (haveS98 && s.tick == tick) {
+            s98Tick.push_back(s);
+            haveS98 = s98Writes.Next(s);
+        }
+        if (!CompareTick(vgmTick, s98Tick, clock.ToSamples(tick), *report)) {
+            return false;
+        }
+    }
+    
+    // Both streams have ended here, so their end and loop ticks are known
+    if (vgmWrites.GetEndTick() != s98Writes.GetEndTick()) {
+        SetMismatch(*report, clock.ToSamples(s98Writes.GetEndTick()),
+                    "song ends at tick %llu, expected tick %llu", (unsigned long long)s98Writes.GetEndTick(),
+                    (unsigned long long)vgmWrites.GetEndTick());
+        return false;
+    }
+    uint64_t vgmLoop = 0;
+    uint64_t s98Loop = 0;
+    bool vgmLoops = vgmWrites.GetLoopTick(vgmLoop);
+    bool s98Loops = s98Writes.GetLoopTick(s98Loop);
+    if (vgmLoops != s98Loops || (vgmLoops && vgmLoop != s98Loop)) {
+        SetMismatch(*report, clock.ToSamples(s98Loop), "loop at tick %llu (set: %d), expected tick %llu (set: %d)",
+                    (unsigned long long)s98Loop, (int)s98Loops, (unsigned long long)vgmLoop, (int)vgmLoops);
+        return false;
+    }
+    
+    // Every GD3 tag must have made it into the S98 tags unchanged
+    std::map<std::string, std::string> expected;
+    std::map<std::string, std::string> tags;
+    ExtractGD3Tags(vgm, vgmHeader, expected);
+    s98.ReadTags(tags);
+    for (std::map<std::string, std::string>::const_iterator it = expected.begin(); it != expected.end(); ++it) {
+        std::map<std::string, std::string>::const_iterator found = tags.find(it->first);
+        if (found == tags.end() || found->second != it->second) {
+            report->error = "Tag '" + it->first + "' differs from the GD3 tag";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool VerifyFiles(VGMReader& vgm, S98Reader& s98, const char* vgmFile, const char* s98File,
+                 const ConvertOptions& options, VerifyReport* report) {
+    VerifyReport local;
+    if (!report) report = &local;
+    
+    if (!vgm.Open(vgmFile)) {
+        report->error = "Could not open input file";
+        return false;
+    }
+    if (!s98.Open(s98File)) {
+        report->error = "Could not open S98 file";
+        vgm.Close();
+        return false;
+    }
+    bool ok = VerifyConversion(vgm, s98, options, report);
+    s98.Close();
+    vgm.Close();
+    return ok;
+}
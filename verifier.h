@@ -0,0 +1,35 @@
+#ifndef VERIFIER_H
+#define VERIFIER_H
+
+#include <stdint.h>
+#include <string>
+#include "converter.h"
+#include "s98_reader.h"
+
+// Outcome of checking one S98 against the VGM it was converted from
+struct VerifyReport {
+    uint64_t writesMatched;
+    uint64_t writesRedundant; // VGM writes missing from the S98 that could not change chip state
+    uint64_t writesUnmapped;  // VGM writes to chips the S98 has no device for
+    uint64_t dacWritesIgnored; // YM2612 DAC writes left out with options.expandDAC
+    uint32_t mismatchSamples; // VGM sample time of the first difference
+    std::string error;        // First difference found; empty when equivalent
+    
+    VerifyReport() : writesMatched(0), writesRedundant(0), writesUnmapped(0), dacWritesIgnored(0),
+                     mismatchSamples(0) {}
+};
+
+// Decode an opened VGM and an opened S98 in lockstep and compare their
+// register writes. Both sides are grouped by S98 timer tick (VGM times are
+// rounded the way the converter rounds them) and, within a tick, compared
+// in order per S98 device ID (device and port). The loop point, the end
+// time and the GD3 tags are checked as well. Only one tick's writes are held
+// at a time. With options.expandDAC, writes to YM2612 register 0x2A are
+// ignored on both sides.
+bool VerifyConversion(VGMReader& vgm, S98Reader& s98, const ConvertOptions& options, VerifyReport* report = NULL);
+
+// Same, between two files
+bool VerifyFiles(VGMReader& vgm, S98Reader& s98, const char* vgmFile, const char* s98File,
+                 const ConvertOptions& options, VerifyReport* report = NULL);
+
+#endif // VERIFIER_H
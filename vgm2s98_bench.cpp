@@ -0,0 +1,446 @@
+// Throughput benchmark for the converter.
+//
+// Generates synthetic VGM images in memory (no input files needed) and
+// times the reader, the writer and the whole conversion separately:
+//
+//   decode   VGMReader::ReadNextCommand over the whole command stream
+//   encode   S98Writer::WriteRegister/WriteWait replaying the decoded stream
+//   convert  Convert() end to end, including header, tags and finalize
+//   pipeline The same with ConvertOptions::pipeline set
+//   dac      The same with ConvertOptions::expandDAC set (serial)
+//
+// Each stage runs several times and the fastest run is reported, which is
+// the most stable figure on a busy machine.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "converter.h"
+
+// Deterministic generator so every run benchmarks the same bytes
+class Random {
+public:
+    explicit Random(uint32_t seed) : state(seed) {}
+    uint32_t Next() {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    }
+    uint32_t Below(uint32_t n) { return Next() % n; }
+
+private:
+    uint32_t state;
+};
+
+// Builds a VGM 1.71 image: 0x100-byte header, command data, GD3 block
+class VGMBuilder {
+public:
+    VGMBuilder() : data(0x100, 0), totalSamples(0) {
+        memcpy(&data[0], "Vgm ", 4);
+        PutUint32(0x08, 0x171);
+        PutUint32(0x34, 0x100 - 0x34);
+    }
+
+    void SetClock(uint32_t headerOffset, uint32_t clock) { PutUint32(headerOffset, clock); }
+
+    void Write(uint8_t cmd, uint8_t reg, uint8_t value) {
+        data.push_back(cmd);
+        data.push_back(reg);
+        data.push_back(value);
+    }
+    void WriteSN(uint8_t value) {
+        data.push_back(0x50);
+        data.push_back(value);
+    }
+    void Wait(uint32_t samples) {
+        totalSamples += samples;
+        if (samples == 735) {
+            data.push_back(0x62);
+        } else if (samples == 882) {
+            data.push_back(0x63);
+        } else if (samples >= 1 && samples <= 16) {
+            data.push_back((uint8_t)(0x70 + samples - 1));
+        } else {
+            data.push_back(0x61);
+            data.push_back((uint8_t)samples);
+            data.push_back((uint8_t)(samples >> 8));
+        }
+    }
+    void DACWrite(uint32_t samples) { // 0x8n: next PCM bank byte to the YM2612 DAC
+        totalSamples += samples;
+        data.push_back((uint8_t)(0x80 + samples));
+    }
+    void DataBlock(uint8_t type, const std::vector<uint8_t>& payload) {
+        data.push_back(0x67);
+        data.push_back(0x66);
+        data.push_back(type);
+        size_t at = data.size();
+        data.resize(at + 4);
+        PutUint32(at, (uint32_t)payload.size());
+        data.insert(data.end(), payload.begin(), payload.end());
+    }
+    void PCMSeek(uint32_t offset) {
+        data.push_back(0xE0);
+        size_t at = data.size();
+        data.resize(at + 4);
+        PutUint32(at, offset);
+    }
+
+    size_t Size() const { return data.size(); }
+
+    std::vector<uint8_t> Finish(const char* title) {
+        data.push_back(0x66);
+
+        // GD3: title only, every other field empty
+        uint32_t gd3 = (uint32_t)data.size();
+        std::vector<uint8_t> strings;
+        for (const char* c = title; *c; c++) {
+            strings.push_back((uint8_t)*c);
+            strings.push_back(0);
+        }
+        strings.resize(strings.size() + 2 * 11, 0);
+        data.insert(data.end(), (const uint8_t*)"Gd3 ", (const uint8_t*)"Gd3 " + 4);
+        data.resize(data.size() + 8);
+        PutUint32(gd3 + 4, 0x100);
+        PutUint32(gd3 + 8, (uint32_t)strings.size());
+        data.insert(data.end(), strings.begin(), strings.end());
+
+        PutUint32(0x04, (uint32_t)data.size() - 0x04);
+        PutUint32(0x14, gd3 - 0x14);
+        PutUint32(0x18, totalSamples);
+        return data;
+    }
+
+private:
+    std::vector<uint8_t> data;
+    uint32_t totalSamples;
+
+    void PutUint32(size_t offset, uint32_t value) {
+        data[offset] = (uint8_t)value;
+        data[offset + 1] = (uint8_t)(value >> 8);
+        data[offset + 2] = (uint8_t)(value >> 16);
+        data[offset + 3] = (uint8_t)(value >> 24);
+    }
+};
+
+// PSG log dominated by short waits: a few tone/volume writes per frame
+static std::vector<uint8_t> GeneratePSGWaits(size_t targetBytes) {
+    VGMBuilder vgm;
+    vgm.SetClock(0x0C, 3579545);
+    Random rng(1);
+    while (vgm.Size() < targetBytes) {
+        for (int i = 0; i < 4; i++) {
+            uint8_t channel = (uint8_t)rng.Below(4);
+            vgm.WriteSN((uint8_t)(0x90 | (channel << 5) | rng.Below(16)));
+            vgm.Wait(1 + rng.Below(16));
+        }
+        vgm.Wait(rng.Below(2) ? 735 : 882);
+    }
+    return vgm.Finish("PSG waits");
+}
+
+// YM2612 and YM2151 register storms: long bursts of FM writes, few waits
+static std::vector<uint8_t> GenerateFMStorm(size_t targetBytes) {
+    VGMBuilder vgm;
+    vgm.SetClock(0x2C, 7670453);
+    vgm.SetClock(0x30, 3579545);
+    Random rng(2);
+    while (vgm.Size() < targetBytes) {
+        for (int i = 0; i < 64; i++) {
+            uint8_t reg = (uint8_t)(0x30 + rng.Below(0x80));
+            vgm.Write((uint8_t)(0x52 + rng.Below(2)), reg, (uint8_t)rng.Next());
+            vgm.Write(0x54, (uint8_t)(0x20 + rng.Below(0xE0)), (uint8_t)rng.Next());
+        }
+        vgm.Write(0x52, 0x28, (uint8_t)(0xF0 | rng.Below(7)));
+        vgm.Wait(1 + rng.Below(200));
+    }
+    return vgm.Finish("FM storm");
+}
+
+// DAC-driven YM2612 log: large PCM data blocks plus sample-by-sample
+// DAC writes, as drum-heavy Mega Drive rips look
+static std::vector<uint8_t> GeneratePCMBlocks(size_t targetBytes) {
+    VGMBuilder vgm;
+    vgm.SetClock(0x2C, 7670453);
+    Random rng(3);
+    std::vector<uint8_t> pcm(1 << 20);
+    while (vgm.Size() < targetBytes) {
+        for (size_t i = 0; i < pcm.size(); i++) {
+            pcm[i] = (uint8_t)rng.Next();
+        }
+        vgm.DataBlock(0x00, pcm);
+        vgm.PCMSeek(0);
+        for (int i = 0; i < 4096; i++) {
+            vgm.DACWrite(rng.Below(4));
+        }
+    }
+    return vgm.Finish("PCM blocks");
+}
+
+// Arcade-style multi-chip log: OPNA, OPM, dual OPN, AY and SN together
+static std::vector<uint8_t> GenerateMultiChip(size_t targetBytes) {
+    VGMBuilder vgm;
+    vgm.SetClock(0x48, 7987200);
+    vgm.SetClock(0x30, 3579545);
+    vgm.SetClock(0x44, 3993600 | 0x40000000);
+    vgm.SetClock(0x74, 1996800);
+    vgm.SetClock(0x0C, 3579545);
+    Random rng(4);
+    static const uint8_t commands[] = { 0x56, 0x57, 0x54, 0x55, 0xA5, 0xA0 };
+    while (vgm.Size() < targetBytes) {
+        for (int i = 0; i < 24; i++) {
+            uint8_t cmd = commands[rng.Below(sizeof(commands))];
+            uint8_t reg = (uint8_t)(cmd == 0xA0 ? rng.Below(14) : 0x30 + rng.Below(0x80));
+            vgm.Write(cmd, reg, (uint8_t)rng.Next());
+        }
+        vgm.WriteSN((uint8_t)(0x90 | rng.Below(16)));
+        vgm.Wait(735);
+    }
+    return vgm.Finish("Multi-chip");
+}
+
+struct Corpus {
+    const char* name;
+    std::vector<uint8_t> (*generate)(size_t targetBytes);
+};
+
+static const Corpus kCorpora[] = {
+    { "psg-waits", GeneratePSGWaits },
+    { "fm-storm", GenerateFMStorm },
+    { "pcm-blocks", GeneratePCMBlocks },
+    { "multi-chip", GenerateMultiChip },
+};
+
+// One decoded command in the form the writer consumes
+struct EncodeOp {
+    uint32_t wait;    // Non-zero: WriteWait(wait)
+    uint8_t deviceId; // Otherwise WriteRegister(deviceId, reg, data)
+    uint8_t reg;
+    uint8_t data;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static double Seconds(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Decode the whole image once; returns the command count
+static uint64_t DecodeAll(VGMReader& reader, const std::vector<uint8_t>& image) {
+    VGMHeader header;
+    if (!reader.Open(image.data(), image.size()) || !reader.ReadHeader(header)) {
+        return 0;
+    }
+    uint64_t count = 0;
+    VGMCommand cmd;
+    while (reader.ReadNextCommand(cmd)) {
+        count++;
+        if (cmd.cmd == VGM_CMD_END) break;
+    }
+    reader.Close();
+    return count;
+}
+
+// Turn the image into writer calls, mapping chips like the converter does
+static void PrepareEncode(const std::vector<uint8_t>& image, std::vector<S98Device>& devices,
+                          std::vector<EncodeOp>& ops) {
+    VGMReader reader;
+    VGMHeader header;
+    S98Writer mapper;
+    if (!reader.Open(image.data(), image.size()) || !reader.ReadHeader(header) || !mapper.Open()) {
+        return;
+    }
+    VGMCommand cmd;
+    while (reader.ReadNextCommand(cmd) && cmd.cmd != VGM_CMD_END) {
+        EncodeOp op = EncodeOp();
+        if (cmd.waitSamples > 0) {
+            op.wait = cmd.waitSamples;
+            ops.push_back(op);
+            continue;
+        }
+        S98DeviceType type = GetS98DeviceType(cmd.cmd);
+        if (type == S98_DEV_NONE) continue;
+        uint8_t id = mapper.GetDeviceId(type, cmd.instance);
+        if (id == 0xFF) {
+            S98Device dev;
+            dev.type = type;
+            dev.clock = GetVGMClock(cmd.cmd, header);
+            dev.instance = cmd.instance;
+            devices.push_back(dev);
+            mapper.AddDevice(type, dev.clock, 0, cmd.instance);
+            id = mapper.GetDeviceId(type, cmd.instance);
+        }
+        op.deviceId = (uint8_t)(id + cmd.port);
+        op.reg = cmd.reg;
+        op.data = cmd.data;
+        ops.push_back(op);
+    }
+}
+
+// Replay the ops into an in-memory writer; returns the S98 size
+static size_t EncodeAll(S98Writer& writer, const std::vector<S98Device>& devices,
+                        const std::vector<EncodeOp>& ops, std::vector<uint8_t>& output) {
+    if (!writer.Open()) {
+        return 0;
+    }
+    for (size_t i = 0; i < devices.size(); i++) {
+        writer.AddDevice(devices[i].type, devices[i].clock, 0, devices[i].instance);
+    }
+    for (size_t i = 0; i < ops.size(); i++) {
+        const EncodeOp& op = ops[i];
+        if (op.wait) {
+            writer.WriteWait(op.wait);
+        } else {
+            writer.WriteRegister(op.deviceId, op.reg, op.data);
+        }
+    }
+    writer.WriteEnd();
+    writer.Finalize();
+    writer.TakeOutput(output);
+    writer.Close();
+    return output.size();
+}
+
+static void Report(const char* corpus, const char* stage, double bytes, double commands, double seconds) {
+    if (seconds <= 0) seconds = 1e-9;
+    printf("%-12s %-8s %10.1f MB/s %10.2f Mcmd/s %9.3f ms\n", corpus, stage,
+           bytes / seconds / 1e6, commands / seconds / 1e6, seconds * 1e3);
+}
+
+static void PrintUsage(const char* program) {
+    fprintf(stderr, "Usage: %s [--size <MB>] [--iterations <n>] [--corpus <name>] [--write-corpus <dir>]\n", program);
+    fprintf(stderr, "Corpora:");
+    for (size_t i = 0; i < sizeof(kCorpora) / sizeof(kCorpora[0]); i++) {
+        fprintf(stderr, " %s", kCorpora[i].name);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char* argv[]) {
+    double sizeMB = 8;
+    int iterations = 5;
+    const char* only = NULL;
+    const char* corpusDir = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--size") == 0 && i + 1 < argc) {
+            sizeMB = atof(argv[++i]);
+        } else if (strcmp(arg, "--iterations") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (strcmp(arg, "--corpus") == 0 && i + 1 < argc) {
+            only = argv[++i];
+        } else if (strcmp(arg, "--write-corpus") == 0 && i + 1 < argc) {
+            corpusDir = argv[++i];
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (sizeMB <= 0 || iterations <= 0) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    size_t targetBytes = (size_t)(sizeMB * 1e6);
+
+    printf("%-12s %-8s %15s %17s %12s\n", "corpus", "stage", "throughput", "commands", "best time");
+
+    bool matched = false;
+    for (size_t c = 0; c < sizeof(kCorpora) / sizeof(kCorpora[0]); c++) {
+        const Corpus& corpus = kCorpora[c];
+        if (only && strcmp(only, corpus.name) != 0) continue;
+        matched = true;
+
+        std::vector<uint8_t> image = corpus.generate(targetBytes);
+        if (corpusDir) {
+            // Keep the generated file for CLI or batch timing
+            std::string path = std::string(corpusDir) + "/" + corpus.name + ".vgm";
+            FILE* f = fopen(path.c_str(), "wb");
+            if (!f || fwrite(image.data(), 1, image.size(), f) != image.size()) {
+                fprintf(stderr, "Error: Could not write %s\n", path.c_str());
+                if (f) fclose(f);
+                return 1;
+            }
+            fclose(f);
+        }
+
+        // Decode
+        VGMReader reader;
+        uint64_t commands = 0;
+        double best = 0;
+        for (int i = 0; i < iterations; i++) {
+            Clock::time_point start = Clock::now();
+            commands = DecodeAll(reader, image);
+            double t = Seconds(start);
+            if (i == 0 || t < best) best = t;
+        }
+        if (commands == 0) {
+            fprintf(stderr, "Error: Generated %s corpus does not decode\n", corpus.name);
+            return 1;
+        }
+        Report(corpus.name, "decode", (double)image.size(), (double)commands, best);
+
+        // Encode
+        std::vector<S98Device> devices;
+        std::vector<EncodeOp> ops;
+        PrepareEncode(image, devices, ops);
+        S98Writer writer;
+        std::vector<uint8_t> output;
+        size_t outputSize = 0;
+        for (int i = 0; i < iterations; i++) {
+            Clock::time_point start = Clock::now();
+            outputSize = EncodeAll(writer, devices, ops, output);
+            double t = Seconds(start);
+            if (i == 0 || t < best) best = t;
+        }
+        Report(corpus.name, "encode", (double)outputSize, (double)ops.size(), best);
+
+        // Whole conversion, measured against input bytes
+        ConvertOptions options;
+        for (int i = 0; i < iterations; i++) {
+            Clock::time_point start = Clock::now();
+            if (!Convert(image.data(), image.size(), output, options)) {
+                fprintf(stderr, "Error: Generated %s corpus does not convert\n", corpus.name);
+                return 1;
+            }
+            double t = Seconds(start);
+            if (i == 0 || t < best) best = t;
+        }
+        Report(corpus.name, "convert", (double)image.size(), (double)commands, best);
+
+        // Same, with decode and encode on two threads
+        options.pipeline = true;
+        for (int i = 0; i < iterations; i++) {
+            Clock::time_point start = Clock::now();
+            if (!Convert(image.data(), image.size(), output, options)) {
+                fprintf(stderr, "Error: Generated %s corpus does not convert\n", corpus.name);
+                return 1;
+            }
+            double t = Seconds(start);
+            if (i == 0 || t < best) best = t;
+        }
+        Report(corpus.name, "pipeline", (double)image.size(), (double)commands, best);
+
+        // Serial again, expanding YM2612 PCM into DAC writes
+        options.pipeline = false;
+        options.expandDAC = true;
+        for (int i = 0; i < iterations; i++) {
+            Clock::time_point start = Clock::now();
+            if (!Convert(image.data(), image.size(), output, options)) {
+                fprintf(stderr, "Error: Generated %s corpus does not convert\n", corpus.name);
+                return 1;
+            }
+            double t = Seconds(start);
+            if (i == 0 || t < best) best = t;
+        }
+        Report(corpus.name, "dac", (double)image.size(), (double)commands, best);
+    }
+
+    if (!matched) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    return 0;
+}
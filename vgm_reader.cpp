@@ -2,7 +2,43 @@
 #include <string.h>
 #include <stdlib.h>
 
-VGMReader::VGMReader() : file(NULL), dataStartOffset(0), loopOffset(0), currentPos(0), fileSize(0) {
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef VGM2S98_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+// Decoded bytes kept in memory at once when inflating .vgz input or
+// reading a stream
+static const uint32_t kInflateWindowSize = 256 * 1024;
+
+// Compressed bytes read from a stream at a time
+static const uint32_t kStreamReadSize = 64 * 1024;
+
+struct VGMReader::InflateState {
+#ifdef VGM2S98_HAVE_ZLIB
+    z_stream stream;
+#endif
+    std::vector<uint8_t> out; // Backing store for the sliding window
+    std::vector<uint8_t> in;  // Compressed bytes, when reading a stream
+    bool finished;            // Stream end or error reached
+    
+    InflateState() : finished(false) {}
+};
+
+VGMReader::VGMReader() : input(NULL), inputSize(0), mappedView(NULL), stream(NULL), streamEnded(false), opened(false),
+                         window(NULL), windowBase(0), windowEnd(0), inflater(NULL), loadBlockData(false),
+                         dataStartOffset(0), loopOffset(0), currentPos(0), fileSize(0) {
 }
 
 VGMReader::~VGMReader() {
@@ -12,88 +48,403 @@ VGMReader::~VGMReader() {
 bool VGMReader::Open(const char* filename) {
     Close();
     
-    file = fopen(filename, "rb");
-    if (!file) {
+    // Prefer a read-only mapping; fall back to one bulk read into memory
+    if (!MapFile(filename) && !LoadFile(filename)) {
         return false;
     }
     
-    // Get file size
-    fseek(file, 0, SEEK_END);
-    fileSize = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    return OpenImage();
+}
+
+bool VGMReader::Open(const uint8_t* data, size_t size) {
+    Close();
     
+    if (size > 0xFFFFFFFF) {
+        return false;
+    }
+    
+    // Caller-owned bytes; they must outlive the reader's use of them
+    input = data;
+    inputSize = (uint32_t)size;
+    return OpenImage();
+}
+
+bool VGMReader::Open(FILE* file) {
+    Close();
+    
+    // Only the first two bytes are needed to tell VGZ from VGM
+    uint8_t magic[2];
+    size_t n = fread(magic, 1, sizeof(magic), file);
+    inputSize = (uint32_t)n;
+    
+    if (n == 2 && magic[0] == 0x1F && magic[1] == 0x8B) {
+        if (!StartInflate()) {
+            Close();
+            return false;
+        }
+        stream = file;
+#ifdef VGM2S98_HAVE_ZLIB
+        inflater->in.assign(magic, magic + n);
+        inflater->in.resize(kStreamReadSize);
+        inflater->stream.next_in = inflater->in.data();
+        inflater->stream.avail_in = (uInt)n;
+#endif
+    } else {
+        stream = file;
+        buffer.assign(magic, magic + n);
+        buffer.resize(kInflateWindowSize);
+        window = buffer.data();
+        windowBase = 0;
+        windowEnd = (uint32_t)n;
+        streamEnded = n < sizeof(magic);
+        fileSize = streamEnded ? windowEnd : 0xFFFFFFFF; // Unknown until the stream ends
+    }
+    
+    opened = true;
+    return true;
+}
+
+bool VGMReader::OpenImage() {
+    // gzip member (.vgz): decode through a streaming inflate window
+    if (inputSize >= 2 && input[0] == 0x1F && input[1] == 0x8B) {
+        if (!StartInflate()) {
+            Close();
+            return false;
+        }
+    } else {
+        window = input;
+        windowBase = 0;
+        windowEnd = inputSize;
+        fileSize = inputSize;
+    }
+    
+    opened = true;
     return true;
 }
 
 void VGMReader::Close() {
-    if (file) {
-        fclose(file);
-        file = NULL;
+#ifdef VGM2S98_HAVE_ZLIB
+    if (inflater) {
+        inflateEnd(&inflater->stream);
     }
+#endif
+    delete inflater;
+    inflater = NULL;
+    UnmapFile();
+    buffer.clear();
+    blockBuffer.clear();
+    input = NULL;
+    inputSize = 0;
+    stream = NULL;
+    streamEnded = false;
+    window = NULL;
+    windowBase = 0;
+    windowEnd = 0;
+    opened = false;
     dataStartOffset = 0;
     loopOffset = 0;
     currentPos = 0;
     fileSize = 0;
 }
 
-bool VGMReader::ReadHeader(VGMHeader& hdr) {
+bool VGMReader::MapFile(const char* filename) {
+#ifdef _WIN32
+    HANDLE fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(fileHandle, &size) || size.QuadPart == 0 || size.QuadPart > 0xFFFFFFFFLL) {
+        CloseHandle(fileHandle);
+        return false;
+    }
+    
+    HANDLE mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(fileHandle);
+    if (!mappingHandle) {
+        return false;
+    }
+    
+    // The view keeps the mapping alive after its handle is closed
+    void* view = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mappingHandle);
+    if (!view) {
+        return false;
+    }
+    
+    inputSize = (uint32_t)size.QuadPart;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+        (uint64_t)st.st_size > 0xFFFFFFFFULL) {
+        close(fd);
+        return false;
+    }
+    
+    void* view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    
+    inputSize = (uint32_t)st.st_size;
+#endif
+    
+    mappedView = view;
+    input = (const uint8_t*)view;
+    return true;
+}
+
+bool VGMReader::LoadFile(const char* filename) {
+    FILE* file = fopen(filename, "rb");
     if (!file) {
         return false;
     }
     
+    // Read the whole file in one go so decoding never touches the file again
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
     fseek(file, 0, SEEK_SET);
+    if (size < 0) {
+        fclose(file);
+        return false;
+    }
     
-    // Check magic
-    char magic[4];
-    if (fread(magic, 1, 4, file) != 4 || memcmp(magic, "Vgm ", 4) != 0) {
+    buffer.resize((size_t)size);
+    size_t bytesRead = size > 0 ? fread(buffer.data(), 1, buffer.size(), file) : 0;
+    fclose(file);
+    buffer.resize(bytesRead);
+    
+    input = buffer.empty() ? NULL : buffer.data();
+    inputSize = (uint32_t)buffer.size();
+    return true;
+}
+
+void VGMReader::UnmapFile() {
+    if (!mappedView) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(mappedView);
+#else
+    munmap(mappedView, inputSize);
+#endif
+    mappedView = NULL;
+}
+
+bool VGMReader::StartInflate() {
+#ifdef VGM2S98_HAVE_ZLIB
+    inflater = new InflateState();
+    inflater->out.resize(kInflateWindowSize);
+    memset(&inflater->stream, 0, sizeof(inflater->stream));
+    
+    // 16 + MAX_WBITS: expect a gzip wrapper
+    if (inflateInit2(&inflater->stream, 16 + MAX_WBITS) != Z_OK) {
+        delete inflater;
+        inflater = NULL;
         return false;
     }
     
-    hdr.eofOffset = ReadUint32();
-    hdr.version = ReadUint32();
-    hdr.sn76489Clock = ReadUint32();
-    hdr.ym2413Clock = ReadUint32();
-    hdr.gd3Offset = ReadUint32();
-    hdr.totalSamples = ReadUint32();
-    hdr.loopOffset = ReadUint32();
-    hdr.loopSamples = ReadUint32();
+    // Decoded size is unknown until the stream ends
+    fileSize = 0xFFFFFFFF;
+    return RewindInflate();
+#else
+    fprintf(stderr, "Error: gzip-compressed input requires a build with zlib\n");
+    return false;
+#endif
+}
+
+bool VGMReader::RewindInflate() {
+#ifdef VGM2S98_HAVE_ZLIB
+    if (stream || !inflater) {
+        return false; // A stream cannot be read again
+    }
+    z_stream& zs = inflater->stream;
+    if (inflateReset(&zs) != Z_OK) {
+        return false;
+    }
+    zs.next_in = (Bytef*)input;
+    zs.avail_in = inputSize;
+    inflater->finished = false;
+    window = inflater->out.data();
+    windowBase = 0;
+    windowEnd = 0;
+    return true;
+#else
+    return false;
+#endif
+}
+
+const uint8_t* VGMReader::Refill(uint32_t offset, uint32_t length) {
+    if (!inflater && !stream) {
+        return NULL; // Raw input image: the window already covers the whole file
+    }
+    
+    // Going backwards means decoding the stream again from the start,
+    // which only an image allows
+    if (offset < windowBase && !RewindInflate()) {
+        return NULL;
+    }
+    
+    std::vector<uint8_t>& out = inflater ? inflater->out : buffer;
+    if (length > out.size()) {
+        out.resize(length);
+        window = out.data();
+    }
+    
+    while (!(offset <= windowEnd && windowEnd - offset >= length)) {
+        // Discard everything before offset, keeping any bytes still needed
+        uint32_t discardTo = offset < windowEnd ? offset : windowEnd;
+        uint32_t kept = windowEnd - discardTo;
+        if (kept > 0 && discardTo > windowBase) {
+            memmove(out.data(), out.data() + (discardTo - windowBase), kept);
+        }
+        windowBase = discardTo;
+        windowEnd = discardTo + kept;
+        
+        if (inflater ? inflater->finished : streamEnded) {
+            return NULL;
+        }
+        windowEnd += ReadSource(out.data() + kept, (uint32_t)(out.size() - kept));
+        if (inflater ? inflater->finished : streamEnded) {
+            fileSize = windowEnd;
+        }
+    }
+    
+    return window + (offset - windowBase);
+}
+
+// Decoded bytes following windowEnd: inflated, or read from a raw stream.
+// Marks the end of the input when it is reached.
+uint32_t VGMReader::ReadSource(uint8_t* dest, uint32_t size) {
+    if (!inflater) {
+        size_t n = fread(dest, 1, size, stream);
+        inputSize += (uint32_t)n;
+        streamEnded = n < size;
+        return (uint32_t)n;
+    }
     
-    // Skip rate (0x24)
-    Seek(0x24);
-    uint32_t rate = ReadUint32();
-    (void)rate;
+#ifdef VGM2S98_HAVE_ZLIB
+    z_stream& zs = inflater->stream;
+    if (zs.avail_in == 0 && stream) {
+        size_t n = fread(inflater->in.data(), 1, inflater->in.size(), stream);
+        inputSize += (uint32_t)n;
+        zs.next_in = inflater->in.data();
+        zs.avail_in = (uInt)n;
+    }
     
-    // Skip SN76489 flags (0x28-0x2B)
-    Seek(0x2C);
-    hdr.ym2612Clock = ReadUint32();
-    hdr.ym2151Clock = ReadUint32();
+    zs.next_out = dest;
+    zs.avail_out = (uInt)size;
+    int ret = inflate(&zs, Z_NO_FLUSH);
+    
+    if (ret == Z_STREAM_END) {
+        inflater->finished = true;
+    } else if (ret != Z_OK) {
+        // Corrupt or truncated stream: treat what we have as the end
+        fprintf(stderr, "Warning: gzip stream ended early (%s)\n", zs.msg ? zs.msg : "truncated");
+        inflater->finished = true;
+    }
+    return size - (uint32_t)zs.avail_out;
+#else
+    (void)dest;
+    (void)size;
+    return 0;
+#endif
+}
+
+bool VGMReader::CopyBytes(uint32_t offset, uint32_t length, uint8_t* dest) {
+    // Copy in window-sized pieces so large blocks never need a larger window
+    const uint32_t chunk = 32 * 1024;
+    while (length > 0) {
+        uint32_t n = length < chunk ? length : chunk;
+        const uint8_t* p = Fetch(offset, n);
+        if (!p) {
+            return false;
+        }
+        memcpy(dest, p, n);
+        dest += n;
+        offset += n;
+        length -= n;
+    }
+    return true;
+}
+
+const uint8_t* VGMReader::GetBytes(uint32_t offset, uint32_t length, std::vector<uint8_t>& scratch) {
+    if (!inflater && !stream) {
+        return Fetch(offset, length); // The window covers the whole file
+    }
+    
+    // Grow the copy a piece at a time, so a corrupt length runs into the
+    // end of the data before it allocates much
+    const uint32_t chunk = 32 * 1024;
+    scratch.clear();
+    while (scratch.size() < length) {
+        uint32_t n = length - (uint32_t)scratch.size();
+        if (n > chunk) n = chunk;
+        const uint8_t* p = Fetch(offset + (uint32_t)scratch.size(), n);
+        if (!p) {
+            return NULL;
+        }
+        scratch.insert(scratch.end(), p, p + n);
+    }
+    return scratch.data();
+}
+
+bool VGMReader::ReadHeader(VGMHeader& hdr) {
+    if (!opened) {
+        return false;
+    }
+    
+    // Check magic
+    const uint8_t* magic = Fetch(0, 4);
+    if (!magic || memcmp(magic, "Vgm ", 4) != 0) {
+        return false;
+    }
+    
+    hdr.eofOffset = ReadUint32(0x04);
+    hdr.version = ReadUint32(0x08);
+    hdr.gd3Offset = ReadUint32(0x14);
+    hdr.totalSamples = ReadUint32(0x18);
+    hdr.loopOffset = ReadUint32(0x1C);
+    hdr.loopSamples = ReadUint32(0x20);
     
     // VGM data offset (0x34)
-    Seek(0x34);
-    hdr.dataOffset = ReadUint32();
+    hdr.dataOffset = ReadUint32(0x34);
     if (hdr.dataOffset == 0) {
         hdr.dataOffset = 0x40; // Default for old VGM files
     } else {
         hdr.dataOffset = hdr.dataOffset + 0x34; // Relative offset from 0x34
     }
     
-    // Skip Sega PCM (0x38-0x3F)
-    Seek(0x40);
-    hdr.ym2203Clock = ReadUint32();
-    hdr.ym2608Clock = ReadUint32();
-    hdr.ym2610Clock = ReadUint32();
-    hdr.ym3812Clock = ReadUint32();
-    hdr.ym3526Clock = ReadUint32();
+    // Header fields at or past the data offset do not exist in this file's
+    // version and must read as zero rather than as command bytes
+    uint32_t headerEnd = hdr.dataOffset < fileSize ? hdr.dataOffset : fileSize;
+    auto ReadField = [this, headerEnd](uint32_t offset) -> uint32_t {
+        return offset + 4 <= headerEnd ? ReadUint32(offset) : 0;
+    };
     
-    // Skip more chips (0x58-0x6F)
-    Seek(0x74);
-    hdr.ay8910Clock = ReadUint32();
+    // Clock fields carry the dual-chip flag in bit 30 (and chip variant
+    // flags in bit 31, e.g. T6W28 for the SN76489)
+    hdr.dualChips = 0;
+    for (uint8_t chip = 0; chip < kVGMChipCount; chip++) {
+        uint32_t value = ReadField(kVGMChips[chip].clockOffset);
+        hdr.clocks[chip] = value & 0x3FFFFFFF;
+        if (hdr.clocks[chip] != 0 && (value & 0x40000000)) {
+            hdr.dualChips |= VGMDualFlag(chip);
+        }
+    }
 
     // Volume Modifier (VGM 1.60+, offset 0x7C)
     // Spec says players should support it in v1.50+ files too.
-    if (hdr.version >= 0x150 && fileSize > 0x7C) {
-        Seek(0x7C);
-        hdr.volumeModifier = (int8_t)ReadUint8();
+    if (hdr.version >= 0x150 && headerEnd > 0x7C) {
+        hdr.volumeModifier = (int8_t)ReadUint8(0x7C);
     } else {
         hdr.volumeModifier = 0;
     }
@@ -106,123 +457,296 @@ bool VGMReader::ReadHeader(VGMHeader& hdr) {
         loopOffset = 0;
     }
     
-    // Seek to data start
-    Seek(dataStartOffset);
+    // Position at data start
     currentPos = dataStartOffset;
     
     header = hdr;
     return true;
 }
 
+// Opcode table: one entry per command byte, built at compile time from the
+// VGM 1.71 command list. Second-chip opcodes are folded onto the first
+// chip's command so callers only see one form.
+struct VGMOpcode {
+    uint8_t length; // Bytes including the opcode (0x67: header only, payload follows)
+    uint8_t kind;   // VGMCommandKind
+    uint8_t cmd;    // Command reported to the caller
+    uint8_t flags;  // kOpcodeSecondChip, kOpcodePort1
+    uint8_t chip;   // kVGMChips row of a chip write, else kVGMChipNone
+    uint16_t wait;  // Samples implied by the opcode itself
+};
+
+static const uint8_t kOpcodeSecondChip = 0x01;
+static const uint8_t kOpcodePort1 = 0x02;
+
+static constexpr uint8_t OpcodeLength(unsigned op) {
+    return op >= 0x30 && op <= 0x3F ? 2 :
+           op >= 0x40 && op <= 0x4E ? 3 :
+           op == 0x4F || op == 0x50 ? 2 :
+           op >= 0x51 && op <= 0x5F ? 3 :
+           op == 0x61 ? 3 :
+           op == 0x64 ? 4 :
+           op == 0x67 ? 7 :
+           op == 0x68 ? 12 :
+           op == 0x90 || op == 0x91 || op == 0x95 ? 5 :
+           op == 0x92 ? 6 :
+           op == 0x93 ? 11 :
+           op == 0x94 ? 2 :
+           op >= 0xA0 && op <= 0xBF ? 3 :
+           op >= 0xC0 && op <= 0xDF ? 4 :
+           op >= 0xE0 ? 5 : 1;
+}
+
+static constexpr uint8_t OpcodeKind(unsigned op) {
+    return op == 0x30 || op == 0x3F || (op >= 0x4F && op <= 0x5F) || (op >= 0xA0 && op <= 0xAF) ? VGM_KIND_WRITE :
+           op == 0x61 || op == 0x62 || op == 0x63 || (op >= 0x70 && op <= 0x7F) ? VGM_KIND_WAIT :
+           op >= 0x80 && op <= 0x8F ? VGM_KIND_DAC_WAIT :
+           op == 0x66 ? VGM_KIND_END :
+           op == 0x67 ? VGM_KIND_DATA_BLOCK :
+           op == 0xE0 ? VGM_KIND_PCM_SEEK :
+           op >= 0x90 && op <= 0x95 ? VGM_KIND_STREAM :
+           (op >= 0x31 && op <= 0x4E) || op == 0x64 || op == 0x68 || op >= 0xB0 ? VGM_KIND_SKIPPED :
+           VGM_KIND_UNKNOWN;
+}
+
+static constexpr uint8_t OpcodeCommand(unsigned op) {
+    return (uint8_t)(op == VGM_CMD_SN76489_2 ? (unsigned)VGM_CMD_SN76489 :
+                     op == VGM_CMD_GG_STEREO_2 ? (unsigned)VGM_CMD_GG_STEREO :
+                     op >= VGM_CMD_SECOND_FIRST && op <= VGM_CMD_SECOND_LAST ? op - 0x50 : op);
+}
+
+// Writes of chips the converter does not know (e.g. 0x5E/0x5F) stay in
+// the table's data-only or register form without a chip
+static constexpr uint8_t OpcodeChip(unsigned op) {
+    return OpcodeKind(op) == VGM_KIND_WRITE ? FindVGMChip(OpcodeCommand(op)) : kVGMChipNone;
+}
+
+static constexpr uint8_t OpcodeFlags(unsigned op) {
+    return (uint8_t)((OpcodeCommand(op) != op ? kOpcodeSecondChip : 0) |
+                     (OpcodeChip(op) != kVGMChipNone && OpcodeCommand(op) != kVGMChips[OpcodeChip(op)].command ?
+                      kOpcodePort1 : 0));
+}
+
+static constexpr uint16_t OpcodeWait(unsigned op) {
+    return (uint16_t)(op == 0x62 ? 735 :
+                      op == 0x63 ? 882 :
+                      op >= 0x70 && op <= 0x7F ? op - 0x6F :
+                      op >= 0x80 && op <= 0x8F ? op - 0x80 : 0);
+}
+
+#define VGM_OPCODE(op) { OpcodeLength(op), OpcodeKind(op), OpcodeCommand(op), OpcodeFlags(op), OpcodeChip(op), \
+                         OpcodeWait(op) }
+#define VGM_OPCODE4(op) VGM_OPCODE(op), VGM_OPCODE(op + 1), VGM_OPCODE(op + 2), VGM_OPCODE(op + 3)
+#define VGM_OPCODE16(op) VGM_OPCODE4(op), VGM_OPCODE4(op + 4), VGM_OPCODE4(op + 8), VGM_OPCODE4(op + 12)
+#define VGM_OPCODE64(op) VGM_OPCODE16(op), VGM_OPCODE16(op + 16), VGM_OPCODE16(op + 32), VGM_OPCODE16(op + 48)
+
+static constexpr VGMOpcode kOpcodes[256] = {
+    VGM_OPCODE64(0x00), VGM_OPCODE64(0x40), VGM_OPCODE64(0x80), VGM_OPCODE64(0xC0)
+};
+
+#undef VGM_OPCODE64
+#undef VGM_OPCODE16
+#undef VGM_OPCODE4
+#undef VGM_OPCODE
+
+static_assert(kOpcodes[0x61].length == 3 && kOpcodes[0x68].length == 12 && kOpcodes[0x93].length == 11 &&
+              kOpcodes[0xE1].length == 5 && kOpcodes[0xA5].cmd == VGM_CMD_YM2203 &&
+              kOpcodes[0x3F].cmd == VGM_CMD_GG_STEREO, "VGM opcode table");
+
+// Every chip row must name a write opcode; only the SN76489 writes data
+// without a register address
+static constexpr bool ChipRowsMatchOpcodes(size_t row = 0) {
+    return row >= kVGMChipCount ||
+           (kOpcodes[kVGMChips[row].command].kind == VGM_KIND_WRITE &&
+            (kOpcodes[kVGMChips[row].command].length == 2) == (kVGMChips[row].s98Type == S98_DEV_SN76489) &&
+            kOpcodes[kVGMChips[row].command + kVGMChips[row].ports - 1].chip == row &&
+            ChipRowsMatchOpcodes(row + 1));
+}
+static_assert(ChipRowsMatchOpcodes(), "VGM chip table disagrees with the opcode table");
+
 bool VGMReader::ReadNextCommand(VGMCommand& cmd) {
-    if (!file || currentPos >= fileSize) {
+    if (!opened || currentPos >= fileSize) {
         return false;
     }
     
-    fseek(file, currentPos, SEEK_SET);
-    uint8_t byte = ReadUint8();
-    currentPos++;
+    const uint8_t* p = Fetch(currentPos, 1);
+    if (!p) {
+        return false;
+    }
+    uint8_t byte = *p;
+    const VGMOpcode& op = kOpcodes[byte];
     
     cmd = VGMCommand();
-    cmd.cmd = byte;
+    cmd.offset = currentPos;
+    cmd.opcode = byte;
+    cmd.cmd = op.cmd;
+    cmd.kind = op.kind;
+    cmd.instance = op.flags & kOpcodeSecondChip;
+    cmd.chip = op.chip;
+    cmd.port = (op.flags & kOpcodePort1) ? 1 : 0;
+    cmd.waitSamples = op.wait;
+    currentPos++;
+    
+    if (op.kind == VGM_KIND_DATA_BLOCK) {
+        return ReadDataBlock(cmd);
+    }
+    
+    // Every other command has a fixed length: fetch its operands at once
+    const uint8_t* args = NULL;
+    if (op.length > 1) {
+        if (!(args = Fetch(currentPos, op.length - 1))) return false;
+        currentPos += op.length - 1;
+    }
     
-    if (byte == VGM_CMD_END) {
-        // End of data
+    switch (op.kind) {
+        case VGM_KIND_WAIT:
+            if (byte == VGM_CMD_WAIT) {
+                // Wait n samples (0x61 nn nn)
+                cmd.waitSamples = (uint16_t)(args[0] | (args[1] << 8));
+            }
+            break;
+        case VGM_KIND_WRITE:
+            if (op.length == 2) {
+                // SN76489 / Game Gear stereo: cmd dd (no register address)
+                cmd.data = args[0];
+            } else {
+                // Register write: cmd reg data
+                cmd.reg = args[0];
+                cmd.data = args[1];
+                
+                // The AY8910 pair shares one opcode; bit 7 of the register
+                // selects the second chip
+                if (byte == VGM_CMD_AY8910 && (cmd.reg & 0x80)) {
+                    cmd.reg &= 0x7F;
+                    cmd.instance = 1;
+                }
+            }
+            break;
+        case VGM_KIND_PCM_SEEK:
+            // PCM seek: 0xE0 oo oo oo oo
+            cmd.pcmOffset = (uint32_t)args[0] | ((uint32_t)args[1] << 8) |
+                            ((uint32_t)args[2] << 16) | ((uint32_t)args[3] << 24);
+            break;
+        case VGM_KIND_STREAM:
+            memcpy(cmd.operands, args, op.length - 1);
+            break;
+        default:
+            // Skipped at its spec length; opcodes the spec does not define
+            // are taken as single bytes
+            break;
+    }
+    
+    return true;
+}
+
+bool VGMReader::ReadDataBlock(VGMCommand& cmd) {
+    // Data block: 0x67 0x66 tt ss ss ss ss [data]
+    const uint8_t* p = Fetch(currentPos, 1);
+    if (!p) return false;
+    uint8_t marker = *p;
+    currentPos++;
+    if (marker != 0x66) {
         return true;
-    } else if (byte == VGM_CMD_WAIT) {
-        // Wait n samples (0x61 nn nn)
-        uint16_t samples = ReadUint16();
-        currentPos += 2;
-        cmd.waitSamples = samples;
-    } else if (byte == VGM_CMD_WAIT_735) {
-        // Wait 735 samples (60Hz)
-        cmd.waitSamples = 735;
-    } else if (byte == VGM_CMD_WAIT_882) {
-        // Wait 882 samples (50Hz)
-        cmd.waitSamples = 882;
-    } else if (byte >= VGM_CMD_WAIT_SHORT && byte <= 0x7F) {
-        // Short wait: 0x70-0x7F = wait 1-16 samples
-        cmd.waitSamples = (byte - VGM_CMD_WAIT_SHORT) + 1;
-    } else if (byte == VGM_CMD_DATA_BLOCK) {
-        // Data block: 0x67 0x66 tt ss ss ss ss [data]
-        uint8_t marker = ReadUint8();
-        currentPos++;
-        if (marker == 0x66) {
-            cmd.blockType = ReadUint8();
-            currentPos++;
-            cmd.blockSize = ReadUint32();
-            currentPos += 4;
-            
-            // Read block data
-            cmd.blockData.resize(cmd.blockSize);
-            if (fread(cmd.blockData.data(), 1, cmd.blockSize, file) == cmd.blockSize) {
-                currentPos += cmd.blockSize;
+    }
+    
+    if (!(p = Fetch(currentPos, 5))) return false;
+    cmd.blockType = p[0];
+    cmd.blockSize = (uint32_t)p[1] | ((uint32_t)p[2] << 8) |
+                    ((uint32_t)p[3] << 16) | ((uint32_t)p[4] << 24);
+    currentPos += 5;
+    
+    // Block data must lie entirely inside the file
+    if (cmd.blockSize > fileSize - currentPos) return false;
+    if (loadBlockData) {
+        if (!inflater && !stream) {
+            cmd.blockData = window + currentPos; // Zero-copy view
+        } else {
+            if (blockBuffer.size() < cmd.blockSize) {
+                blockBuffer.resize(cmd.blockSize);
+            }
+            if (!CopyBytes(currentPos, cmd.blockSize, blockBuffer.data())) return false;
+            cmd.blockData = blockBuffer.data();
+        }
+    }
+    // Skipped blocks are never touched; .vgz and stream input read past
+    // them on the next fetch
+    currentPos += cmd.blockSize;
+    return true;
+}
+
+bool VGMReader::ScanChunks(uint32_t chunkBytes, uint32_t loopOffset, std::vector<VGMChunk>& chunks,
+                           uint32_t& loopCommand) {
+    chunks.clear();
+    loopCommand = 0;
+    if (!opened || inflater || stream) {
+        return false; // Only an image can be read at several places at once
+    }
+    
+    uint32_t pos = dataStartOffset;
+    uint32_t nextChunk = pos;
+    uint64_t samples = 0;
+    while (pos < fileSize) {
+        if (pos >= nextChunk) {
+            VGMChunk chunk = { pos, samples };
+            chunks.push_back(chunk);
+            nextChunk = pos + chunkBytes;
+        }
+        if (loopCommand == 0 && loopOffset > 0 && pos >= loopOffset) {
+            loopCommand = pos;
+        }
+        
+        const uint8_t* p = window + pos;
+        const VGMOpcode& op = kOpcodes[p[0]];
+        uint32_t left = fileSize - pos;
+        uint32_t length = op.length;
+        if (op.kind == VGM_KIND_DATA_BLOCK) {
+            // 0x67 0x66 tt ss ss ss ss [data]; without the 0x66 only two bytes
+            if (left < 2) break;
+            if (p[1] == 0x66) {
+                if (left < 7) break;
+                uint32_t size = (uint32_t)p[3] | ((uint32_t)p[4] << 8) | ((uint32_t)p[5] << 16) |
+                                ((uint32_t)p[6] << 24);
+                if (size > left - 7) break;
+                length = 7 + size;
+            } else {
+                length = 2;
             }
+        } else if (length > left) {
+            break;
         }
-    } else if (byte == VGM_CMD_PCM_SEEK) {
-        // PCM seek: 0xE0 oo oo oo oo
-        cmd.pcmOffset = ReadUint32();
-        currentPos += 4;
-    } else if (byte == VGM_CMD_SN76489 || byte == VGM_CMD_YM2413 || 
-               byte == VGM_CMD_YM2612_PORT0 || byte == VGM_CMD_YM2612_PORT1 ||
-               byte == VGM_CMD_YM2151 || byte == VGM_CMD_YM2203 ||
-               byte == VGM_CMD_YM2608_PORT0 || byte == VGM_CMD_YM2608_PORT1 ||
-               byte == VGM_CMD_YM2610_PORT0 || byte == VGM_CMD_YM2610_PORT1 ||
-               byte == VGM_CMD_YM3812 || byte == VGM_CMD_YM3526 ||
-               byte == VGM_CMD_AY8910) {
-        // Register write: cmd reg data
-        cmd.reg = ReadUint8();
-        cmd.data = ReadUint8();
-        currentPos += 2;
         
-        // Determine port
-        if (byte == VGM_CMD_YM2612_PORT1 || byte == VGM_CMD_YM2608_PORT1 || 
-            byte == VGM_CMD_YM2610_PORT1) {
-            cmd.port = 1;
-        } else {
-            cmd.port = 0;
+        samples += p[0] == VGM_CMD_WAIT ? (uint32_t)(p[1] | (p[2] << 8)) : op.wait;
+        if (op.kind == VGM_KIND_END) {
+            break;
         }
-    } else {
-        // Unknown command - skip it
-        fprintf(stderr, "Warning: Unknown VGM command 0x%02X at offset 0x%X\n", byte, currentPos - 1);
+        pos += length;
     }
-    
     return true;
 }
 
 void VGMReader::Reset() {
-    if (file && dataStartOffset > 0) {
-        Seek(dataStartOffset);
+    if (opened && dataStartOffset > 0) {
         currentPos = dataStartOffset;
     }
 }
 
-uint8_t VGMReader::ReadUint8() {
-    uint8_t value = 0;
-    if (file) {
-        fread(&value, 1, 1, file);
-    }
-    return value;
-}
-
-uint16_t VGMReader::ReadUint16() {
-    uint16_t value = 0;
-    if (file) {
-        fread(&value, 1, 2, file);
-    }
-    return value;
+uint8_t VGMReader::ReadUint8(uint32_t offset) {
+    const uint8_t* p = Fetch(offset, 1);
+    return p ? p[0] : 0;
 }
 
-uint32_t VGMReader::ReadUint32() {
-    uint32_t value = 0;
-    if (file) {
-        fread(&value, 1, 4, file);
+uint16_t VGMReader::ReadUint16(uint32_t offset) {
+    const uint8_t* p = Fetch(offset, 2);
+    if (!p) {
+        return 0;
     }
-    return value;
+    return (uint16_t)(p[0] | (p[1] << 8));
 }
 
-void VGMReader::Seek(uint32_t offset) {
-    if (file) {
-        fseek(file, offset, SEEK_SET);
+uint32_t VGMReader::ReadUint32(uint32_t offset) {
+    const uint8_t* p = Fetch(offset, 4);
+    if (!p) {
+        return 0;
     }
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
 }
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <vector>
 #include <string>
+#include "chip_table.h"
 
 // VGM command types
 enum VGMCommandType {
@@ -12,6 +13,7 @@ enum VGMCommandType {
     VGM_CMD_WAIT_735 = 0x62,  // 60Hz wait
     VGM_CMD_WAIT_882 = 0x63,  // 50Hz wait
     VGM_CMD_WAIT_SHORT = 0x70, // 0x70-0x7F: wait 1-16 samples
+    VGM_CMD_DAC_WAIT = 0x80,   // 0x80-0x8F: YM2612 DAC write, then wait 0-15 samples
     VGM_CMD_END = 0x66,
     
     // Chip write commands
@@ -27,7 +29,15 @@ enum VGMCommandType {
     VGM_CMD_YM2610_PORT1 = 0x59,
     VGM_CMD_YM3812 = 0x5A,
     VGM_CMD_YM3526 = 0x5B,
-    VGM_CMD_AY8910 = 0xA0,
+    VGM_CMD_AY8910 = 0xA0,   // Register bit 7 selects the second chip
+    VGM_CMD_GG_STEREO = 0x4F,
+    
+    // Second chip of a dual pair; normalized to the first chip's command
+    // with VGMCommand::instance = 1
+    VGM_CMD_SN76489_2 = 0x30,
+    VGM_CMD_GG_STEREO_2 = 0x3F,
+    VGM_CMD_SECOND_FIRST = 0xA1, // 0xA1-0xAF mirror 0x51-0x5F
+    VGM_CMD_SECOND_LAST = 0xAF,
     
     // Data block
     VGM_CMD_DATA_BLOCK = 0x67,
@@ -36,19 +46,47 @@ enum VGMCommandType {
     VGM_CMD_PCM_SEEK = 0xE0,
 };
 
+// What a decoded command does, independent of the chip it addresses
+enum VGMCommandKind {
+    VGM_KIND_UNKNOWN = 0,  // Not defined by the VGM spec (consumed as one byte)
+    VGM_KIND_END,          // 0x66
+    VGM_KIND_WAIT,         // 0x61-0x63, 0x70-0x7F
+    VGM_KIND_WRITE,        // Chip write: reg/data, or data only (0x4F, 0x50)
+    VGM_KIND_DATA_BLOCK,   // 0x67
+    VGM_KIND_PCM_SEEK,     // 0xE0
+    VGM_KIND_DAC_WAIT,     // 0x80-0x8F: YM2612 DAC write from the PCM bank, then wait
+    VGM_KIND_STREAM,       // 0x90-0x95 DAC stream control
+    VGM_KIND_SKIPPED       // Spec-defined but not converted (reserved, other chips)
+};
+
 struct VGMCommand {
-    uint8_t cmd;
+    uint32_t offset;       // File offset of the command byte
+    uint8_t opcode;        // Command byte as stored in the file
+    uint8_t cmd;           // Second-chip opcodes are reported as the first chip's
+    uint8_t kind;          // VGMCommandKind
+    uint8_t instance;      // Chip instance for register writes (0 or 1)
+    uint8_t chip;          // kVGMChips row of a converted chip's write, else kVGMChipNone
     uint32_t waitSamples;  // For wait commands
     uint8_t reg;           // For register writes
     uint8_t data;          // For register writes
     uint8_t port;          // For chips with ports (0 or 1)
     uint32_t blockType;    // For data blocks
     uint32_t blockSize;    // For data blocks
-    std::vector<uint8_t> blockData; // For data blocks
+    // For data blocks: view of the payload, only set when the reader loads
+    // block data (see VGMReader::SetLoadBlockData). Valid until the next
+    // ReadNextCommand call.
+    const uint8_t* blockData;
     uint32_t pcmOffset;    // For PCM seek
+    uint8_t operands[10];  // Raw operand bytes of DAC stream commands (0x90-0x95)
     
-    VGMCommand() : cmd(0), waitSamples(0), reg(0), data(0), port(0), 
-                   blockType(0), blockSize(0), pcmOffset(0) {}
+    VGMCommand() : offset(0), opcode(0), cmd(0), kind(VGM_KIND_UNKNOWN), instance(0), chip(kVGMChipNone), waitSamples(0), reg(0), data(0), port(0), 
+                   blockType(0), blockSize(0), blockData(NULL), pcmOffset(0), operands() {}
+};
+
+// One piece of the command stream, for encoding pieces in parallel
+struct VGMChunk {
+    uint32_t offset;  // File offset of the first command
+    uint64_t samples; // Sample time at that command
 };
 
 struct VGMHeader {
@@ -60,28 +98,17 @@ struct VGMHeader {
     uint32_t dataOffset;
     uint32_t gd3Offset;
     
-    // Chip clocks
-    uint32_t sn76489Clock;
-    uint32_t ym2413Clock;
-    uint32_t ym2612Clock;
-    uint32_t ym2151Clock;
-    uint32_t ym2203Clock;
-    uint32_t ym2608Clock;
-    uint32_t ym2610Clock;
-    uint32_t ym3812Clock;
-    uint32_t ym3526Clock;
-    uint32_t ay8910Clock;
+    // Chip clocks by kVGMChips row, with the flag bits (30-31) masked off
+    uint32_t clocks[kVGMChipCount];
+    uint32_t dualChips; // VGMDualFlag bits: bit 30 of the clock declared a second chip
 
     // Volume modifier (VGM 1.60+, offset 0x7C)
     // Volume = 2 ^ (volumeModifier / 32.0); default 0 => factor 1.0
     int8_t volumeModifier;
     
     VGMHeader() : version(0), eofOffset(0), totalSamples(0), loopOffset(0),
-                  loopSamples(0), dataOffset(0), gd3Offset(0),
-                  sn76489Clock(0), ym2413Clock(0), ym2612Clock(0),
-                  ym2151Clock(0), ym2203Clock(0), ym2608Clock(0),
-                  ym2610Clock(0), ym3812Clock(0), ym3526Clock(0), ay8910Clock(0),
-                  volumeModifier(0) {}
+                  loopSamples(0), dataOffset(0), gd3Offset(0), clocks(),
+                  dualChips(0), volumeModifier(0) {}
 };
 
 // VGM Reader class
@@ -91,29 +118,101 @@ public:
     ~VGMReader();
     
     bool Open(const char* filename);
+    bool Open(const uint8_t* data, size_t size); // In-memory VGM/VGZ image, not copied
+    // VGM/VGZ read front to back from a stream the caller owns (e.g. stdin).
+    // Nothing before the current window can be read again, so Reset and
+    // backward reads fail; see IsSeekable.
+    bool Open(FILE* stream);
     void Close();
     
     bool ReadHeader(VGMHeader& header);
     bool ReadNextCommand(VGMCommand& cmd);
     void Reset(); // Reset to start of data
+    void Seek(uint32_t offset) { currentPos = offset; } // Continue at a command boundary
+    
+    // Split the command stream of an uncompressed image into chunks of about
+    // chunkBytes each, at command boundaries, by command lengths alone.
+    // The scan stops where ReadNextCommand would: after the end command or
+    // at a command cut off by the end of the file. loopCommand is set to
+    // the first command at or past loopOffset (0 if none). Returns false
+    // for .vgz and stream input.
+    bool ScanChunks(uint32_t chunkBytes, uint32_t loopOffset, std::vector<VGMChunk>& chunks, uint32_t& loopCommand);
+    
+    // Data block payloads are skipped unless enabled here. An uncompressed
+    // image hands out a view into itself; .vgz and stream input copy into
+    // a buffer that is reused from block to block.
+    void SetLoadBlockData(bool load) { loadBlockData = load; }
+    
+    // Copy decoded bytes at an absolute file offset (e.g. the GD3 block)
+    bool ReadBytes(uint32_t offset, uint32_t length, uint8_t* dest) { return CopyBytes(offset, length, dest); }
     
-    bool IsOpen() const { return file != NULL; }
+    // Decoded bytes at an absolute file offset without a copy where possible:
+    // a view into the file image for raw input (valid while the reader is
+    // open), the bytes copied into scratch for .vgz and streams. NULL past
+    // the end of the data. length must not be 0.
+    const uint8_t* GetBytes(uint32_t offset, uint32_t length, std::vector<uint8_t>& scratch);
+    
+    bool IsOpen() const { return opened; }
+    bool IsSeekable() const { return stream == NULL; }
+    bool IsCompressed() const { return inflater != NULL; }
     uint32_t GetCurrentPosition() const { return currentPos; }
+    uint32_t GetInputSize() const { return inputSize; } // Bytes as stored (so far, for streams)
+    const uint8_t* GetInputData() const { return input; } // NULL for streams
     uint32_t GetDataStartOffset() const { return dataStartOffset; }
     uint32_t GetLoopOffset() const { return loopOffset; }
     
 private:
-    FILE* file;
+    struct InflateState;
+    
+    // Raw input image: a read-only mapping of the file or, where mapping is
+    // unavailable, one buffer. For .vgz this holds the compressed bytes.
+    const uint8_t* input;
+    uint32_t inputSize;
+    void* mappedView;              // Non-NULL when input points at a file mapping
+    std::vector<uint8_t> buffer;   // Fallback storage when mapping fails; window storage for raw streams
+    FILE* stream;                  // Sequential input, not owned; NULL for images
+    bool streamEnded;              // Raw stream: no bytes after windowEnd
+    bool opened;
+    
+    // Decoded bytes [windowBase, windowEnd) are addressable through window.
+    // For raw VGM this is the whole input; for .vgz it is a bounded sliding
+    // window refilled by streaming inflate.
+    const uint8_t* window;
+    uint32_t windowBase;
+    uint32_t windowEnd;
+    InflateState* inflater;
+    
+    bool loadBlockData;
+    std::vector<uint8_t> blockBuffer; // Reused block storage for .vgz input
+    
     VGMHeader header;
     uint32_t dataStartOffset;
     uint32_t loopOffset;
     uint32_t currentPos;
     uint32_t fileSize;
     
-    uint8_t ReadUint8();
-    uint16_t ReadUint16();
-    uint32_t ReadUint32();
-    void Seek(uint32_t offset);
+    bool OpenImage();
+    bool MapFile(const char* filename);
+    bool LoadFile(const char* filename);
+    void UnmapFile();
+    bool StartInflate();
+    bool ReadDataBlock(VGMCommand& cmd);
+    bool RewindInflate();
+    uint32_t ReadSource(uint8_t* dest, uint32_t size);
+    
+    // Pointer to length decoded bytes at offset, or NULL past end of data
+    const uint8_t* Fetch(uint32_t offset, uint32_t length) {
+        if (offset >= windowBase && offset <= windowEnd && windowEnd - offset >= length) {
+            return window + (offset - windowBase);
+        }
+        return Refill(offset, length);
+    }
+    const uint8_t* Refill(uint32_t offset, uint32_t length);
+    bool CopyBytes(uint32_t offset, uint32_t length, uint8_t* dest);
+    
+    uint8_t ReadUint8(uint32_t offset);
+    uint16_t ReadUint16(uint32_t offset);
+    uint32_t ReadUint32(uint32_t offset);
 };
 
 #endif // VGM_READER_H
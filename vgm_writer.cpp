@@ -0,0 +1,299 @@
+#include "vgm_writer.h"
+#include <string.h>
+#include "chip_table.h"
+
+// VGM 1.51 header: every field up to the AY8910 type and volume modifier
+static const uint32_t kHeaderSize = 0x80;
+
+// Longest single 0x61 wait
+static const uint32_t kMaxWait = 65535;
+
+// Header clock field of the chip written with vgmCmd (0 = none)
+static uint32_t GetClockOffset(uint8_t vgmCmd) {
+    uint8_t chip = FindVGMChip(vgmCmd);
+    return chip != kVGMChipNone && vgmCmd == kVGMChips[chip].command ? kVGMChips[chip].clockOffset : 0;
+}
+
+// The one-byte wait lasting exactly samples, or 0 if there is none
+static uint8_t GetShortWaitOpcode(uint32_t samples) {
+    if (samples >= 1 && samples <= 16) return (uint8_t)(0x6F + samples); // 0x70-0x7F
+    if (samples == 735) return 0x62;
+    if (samples == 882) return 0x63;
+    return 0;
+}
+
+// Shortest wait of at least samples that one or two one-byte waits cover,
+// preferring a single byte; 0 if only 0x61 can
+static uint32_t GetShortTail(uint32_t samples) {
+    if (samples <= 16) return samples;
+    if (samples <= 735) return 735;
+    if (samples <= 882) return 882;
+    if (samples <= 882 + 16) return samples;
+    if (samples <= 735 * 2) return 735 * 2;
+    if (samples <= 735 + 882) return 735 + 882;
+    if (samples <= 882 * 2) return 882 * 2;
+    return 0;
+}
+
+// Append one code point as UTF-16LE
+static void AppendUTF16LE(std::vector<uint8_t>& out, uint32_t c) {
+    if (c >= 0x10000) {
+        c -= 0x10000;
+        AppendUTF16LE(out, 0xD800 | (c >> 10));
+        AppendUTF16LE(out, 0xDC00 | (c & 0x3FF));
+        return;
+    }
+    out.push_back((uint8_t)(c & 0xFF));
+    out.push_back((uint8_t)(c >> 8));
+}
+
+// Encode UTF-8 text as a NUL-terminated GD3 string; malformed sequences
+// become U+FFFD
+static void AppendGD3String(std::vector<uint8_t>& out, const std::string& text) {
+    const uint8_t* p = (const uint8_t*)text.data();
+    size_t size = text.size();
+    size_t i = 0;
+    while (i < size) {
+        uint32_t c = p[i];
+        size_t length = c < 0x80 ? 1 : (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 : (c & 0xF8) == 0xF0 ? 4 : 0;
+        if (length == 0 || i + length > size) {
+            AppendUTF16LE(out, 0xFFFD);
+            i++;
+            continue;
+        }
+        if (length > 1) {
+            c &= 0x7F >> length;
+            size_t j = 1;
+            for (; j < length && (p[i + j] & 0xC0) == 0x80; j++) {
+                c = (c << 6) | (p[i + j] & 0x3F);
+            }
+            if (j < length || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) {
+                AppendUTF16LE(out, 0xFFFD);
+                i += j;
+                continue;
+            }
+        }
+        AppendUTF16LE(out, c);
+        i += length;
+    }
+    AppendUTF16LE(out, 0);
+}
+
+VGMWriter::VGMWriter() : file(NULL), opened(false), totalSamples(0), loopOffset(0), loopStartSamples(0),
+                         gd3Offset(0), finalized(false) {
+}
+
+VGMWriter::~VGMWriter() {
+    Close();
+}
+
+bool VGMWriter::Open(const char* filename) {
+    Close();
+    
+    // Replace rather than rewrite, as S98Writer does
+    remove(filename);
+    file = fopen(filename, "wb");
+    if (!file) {
+        return false;
+    }
+    
+    return Open();
+}
+
+bool VGMWriter::Open() {
+    if (opened) {
+        Close();
+    }
+    opened = true;
+    
+    // Header fields are patched in place; unset clocks stay 0
+    output.assign(kHeaderSize, 0);
+    memcpy(output.data(), "Vgm ", 4);
+    PatchUint32(0x08, 0x151);
+    PatchUint32(0x34, kHeaderSize - 0x34); // Data offset, relative to 0x34
+    
+    return true;
+}
+
+void VGMWriter::Close() {
+    if (opened) {
+        Finalize();
+    }
+    if (file) {
+        fclose(file);
+        file = NULL;
+    }
+    opened = false;
+    output.clear();
+    totalSamples = 0;
+    loopOffset = 0;
+    loopStartSamples = 0;
+    gd3Offset = 0;
+    finalized = false;
+}
+
+void VGMWriter::SetClock(uint8_t vgmCmd, uint32_t clock, bool dual) {
+    uint32_t offset = GetClockOffset(vgmCmd);
+    if (!opened || offset == 0) return;
+    
+    PatchUint32(offset, (clock & 0x3FFFFFFF) | (dual ? 0x40000000 : 0));
+}
+
+uint32_t VGMWriter::GetClock(uint8_t vgmCmd) const {
+    uint32_t offset = GetClockOffset(vgmCmd);
+    if (!opened || offset == 0) return 0;
+    
+    return ReadUint32(offset) & 0x3FFFFFFF;
+}
+
+void VGMWriter::SetAY8910Type(uint8_t type) {
+    if (!opened) return;
+    
+    output[0x78] = type;
+}
+
+void VGMWriter::SetVolumeModifier(int8_t volumeModifier) {
+    if (!opened) return;
+    
+    output[0x7C] = (uint8_t)volumeModifier;
+}
+
+void VGMWriter::WriteWait(uint32_t samples) {
+    if (!opened || samples == 0) return;
+    
+    totalSamples += samples;
+    
+    // Whole 0x61 waits until at most two are needed
+    while (samples > 2 * kMaxWait) {
+        WriteLongWait(kMaxWait);
+        samples -= kMaxWait;
+    }
+    
+    // Split what is left over two waits so that the second is as short to
+    // encode as possible
+    if (samples > kMaxWait) {
+        uint32_t tail = GetShortTail(samples - kMaxWait);
+        if (tail == 0) {
+            tail = samples - kMaxWait;
+        }
+        WriteLongWait(samples - tail);
+        samples = tail;
+    }
+    WriteShortWait(samples);
+}
+
+void VGMWriter::WriteLongWait(uint32_t samples) {
+    const uint8_t bytes[3] = { 0x61, (uint8_t)(samples & 0xFF), (uint8_t)(samples >> 8) };
+    output.insert(output.end(), bytes, bytes + 3);
+}
+
+// Up to kMaxWait samples in one, two or three bytes
+void VGMWriter::WriteShortWait(uint32_t samples) {
+    if (samples == 0) return;
+    
+    uint8_t op = GetShortWaitOpcode(samples);
+    if (op != 0) {
+        WriteUint8(op);
+        return;
+    }
+    
+    // Two one-byte waits, longest first
+    static const uint32_t kFirst[3] = { 882, 735, 16 };
+    for (int i = 0; i < 3; i++) {
+        if (samples > kFirst[i] && (op = GetShortWaitOpcode(samples - kFirst[i])) != 0) {
+            WriteUint8(GetShortWaitOpcode(kFirst[i]));
+            WriteUint8(op);
+            return;
+        }
+    }
+    
+    WriteLongWait(samples);
+}
+
+void VGMWriter::WriteRegister(uint8_t vgmCmd, uint8_t instance, uint8_t reg, uint8_t data) {
+    if (!opened) return;
+    
+    // SN76489: data only; its second chip has an opcode of its own
+    if (vgmCmd == 0x50) {
+        WriteUint8(instance ? 0x30 : 0x50);
+        WriteUint8(data);
+        return;
+    }
+    
+    // The AY8910 pair shares one opcode and uses register bit 7; the
+    // other second chips are written with 0xA1-0xAF
+    if (instance) {
+        if (vgmCmd == 0xA0) {
+            reg |= 0x80;
+        } else {
+            vgmCmd += 0x50;
+        }
+    }
+    const uint8_t bytes[3] = { vgmCmd, reg, data };
+    output.insert(output.end(), bytes, bytes + 3);
+}
+
+void VGMWriter::WriteEnd() {
+    if (!opened) return;
+    
+    WriteUint8(0x66);
+}
+
+void VGMWriter::SetLoopPoint() {
+    if (!opened || loopOffset != 0) return;
+    
+    loopOffset = (uint32_t)output.size();
+    loopStartSamples = totalSamples;
+}
+
+void VGMWriter::WriteGD3(const std::vector<std::string>& strings) {
+    if (!opened) return;
+    
+    gd3Offset = (uint32_t)output.size();
+    output.insert(output.end(), "Gd3 ", "Gd3 " + 4);
+    output.insert(output.end(), 8, 0); // Version and length, patched below
+    PatchUint32(gd3Offset + 4, 0x100);
+    
+    // Eleven strings, missing ones empty
+    size_t start = output.size();
+    for (size_t i = 0; i < 11; i++) {
+        AppendGD3String(output, i < strings.size() ? strings[i] : std::string());
+    }
+    PatchUint32(gd3Offset + 8, (uint32_t)(output.size() - start));
+}
+
+bool VGMWriter::Finalize() {
+    if (!opened) return false;
+    if (finalized) return true;
+    finalized = true;
+    
+    // Offsets are stored relative to their own field
+    PatchUint32(0x04, (uint32_t)output.size() - 0x04);
+    PatchUint32(0x14, gd3Offset ? gd3Offset - 0x14 : 0);
+    PatchUint32(0x18, totalSamples);
+    
+    // A loop with no length would never advance
+    if (loopOffset != 0 && totalSamples > loopStartSamples) {
+        PatchUint32(0x1C, loopOffset - 0x1C);
+        PatchUint32(0x20, totalSamples - loopStartSamples);
+    }
+    
+    // Flush the whole image with one large write
+    if (!file) {
+        return true;
+    }
+    return fwrite(output.data(), 1, output.size(), file) == output.size() && fflush(file) == 0;
+}
+
+void VGMWriter::PatchUint32(uint32_t offset, uint32_t value) {
+    uint8_t* p = &output[offset];
+    p[0] = (uint8_t)(value & 0xFF);
+    p[1] = (uint8_t)((value >> 8) & 0xFF);
+    p[2] = (uint8_t)((value >> 16) & 0xFF);
+    p[3] = (uint8_t)((value >> 24) & 0xFF);
+}
+
+uint32_t VGMWriter::ReadUint32(uint32_t offset) const {
+    const uint8_t* p = &output[offset];
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
@@ -0,0 +1,69 @@
+#ifndef VGM_WRITER_H
+#define VGM_WRITER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <map>
+
+// VGM Writer class, the counterpart of VGMReader. Writes VGM 1.51 (the
+// first version with every chip clock VGMReader knows) with a 0x80-byte
+// header. Like S98Writer, the file is built in memory and written out by
+// Finalize.
+class VGMWriter {
+public:
+    VGMWriter();
+    ~VGMWriter();
+    
+    bool Open(const char* filename);
+    bool Open(); // Build the file in memory only; fetch it with TakeOutput
+    void Close();
+    
+    // Header clock of the chip written with vgmCmd (the first chip's
+    // opcode, port 0). dual declares a second instance (bit 30).
+    void SetClock(uint8_t vgmCmd, uint32_t clock, bool dual = false);
+    uint32_t GetClock(uint8_t vgmCmd) const; // 0 = chip not present
+    void SetAY8910Type(uint8_t type);          // 0x00 AY8910, 0x10 YM2149, ...
+    void SetVolumeModifier(int8_t volumeModifier);
+    
+    // Write commands
+    void WriteWait(uint32_t samples); // Shortest mix of 0x7n, 0x62, 0x63 and 0x61
+    void WriteRegister(uint8_t vgmCmd, uint8_t instance, uint8_t reg, uint8_t data);
+    void WriteEnd();
+    
+    // Set loop point at the next command
+    void SetLoopPoint();
+    
+    // Write the GD3 block; call after WriteEnd. strings are the 11 GD3
+    // fields in order, as UTF-8.
+    void WriteGD3(const std::vector<std::string>& strings);
+    
+    // Finalize file (patch header with offsets and sample counts, flush to disk)
+    bool Finalize();
+    
+    bool IsOpen() const { return opened; }
+    uint32_t GetFileSize() const { return (uint32_t)output.size(); }
+    uint32_t GetTotalSamples() const { return totalSamples; }
+    
+    // Move the finalized file image out of the writer
+    void TakeOutput(std::vector<uint8_t>& dest) { dest.swap(output); output.clear(); }
+    
+private:
+    FILE* file; // NULL when writing to memory only
+    bool opened;
+    std::vector<uint8_t> output;
+    uint32_t totalSamples;
+    uint32_t loopOffset;      // Absolute; 0 = no loop
+    uint32_t loopStartSamples;
+    uint32_t gd3Offset;       // Absolute; 0 = no GD3
+    bool finalized;
+    
+    void WriteUint8(uint8_t value) { output.push_back(value); }
+    void WriteLongWait(uint32_t samples);
+    void WriteShortWait(uint32_t samples);
+    void PatchUint32(uint32_t offset, uint32_t value);
+    uint32_t ReadUint32(uint32_t offset) const;
+};
+
+#endif // VGM_WRITER_H
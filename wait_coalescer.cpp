@@ -0,0 +1,114 @@
+#include "wait_coalescer.h"
+
+WaitCoalescer::WaitCoalescer(S98Writer& w, bool enable)
+    : writer(w), enabled(enable), pending(0), separateBytes(0), writtenBytes(0),
+      separateSampleTime(0), separateTickTime(0),
+      ticksPerSampleNum(1), ticksPerSampleDen(1), sampleTime(0), tickTime(0), maxErrorScaled(0),
+      deferOpening(false), hasOpening(false), openingTick(0) {
+}
+
+void WaitCoalescer::SetTimer(uint32_t numerator, uint32_t denominator) {
+    // A tick of numerator/denominator seconds is 44100 * numerator / denominator samples
+    ticksPerSampleNum = denominator;
+    ticksPerSampleDen = (uint64_t)numerator * 44100;
+}
+
+void WaitCoalescer::StartChunk(uint64_t startSamples) {
+    sampleTime = startSamples;
+    tickTime = ToTick(startSamples);
+    separateSampleTime = sampleTime;
+    separateTickTime = tickTime;
+    
+    // Without coalescing each wait is written on its own, so none spans
+    // the boundary and the chunk can carry on from the start time
+    deferOpening = enabled;
+}
+
+void WaitCoalescer::JoinChunk(const WaitCoalescer& chunk) {
+    if (chunk.hasOpening && chunk.openingTick > tickTime) {
+        uint32_t ticks = (uint32_t)(chunk.openingTick - tickTime);
+        writer.WriteWait(ticks);
+        writtenBytes += S98Writer::GetWaitSize(ticks);
+    }
+    
+    // A chunk that never flushed leaves its waits to the next one
+    if (!chunk.deferOpening) {
+        sampleTime = chunk.sampleTime;
+        tickTime = chunk.tickTime;
+    }
+    separateSampleTime = chunk.separateSampleTime;
+    separateTickTime = chunk.separateTickTime;
+    separateBytes += chunk.separateBytes;
+    writtenBytes += chunk.writtenBytes;
+    if (chunk.maxErrorScaled > maxErrorScaled) maxErrorScaled = chunk.maxErrorScaled;
+}
+
+// Round the absolute time, not the wait, so errors do not add up
+uint64_t WaitCoalescer::ToTick(uint64_t samples) const {
+    if (ticksPerSampleNum == ticksPerSampleDen) {
+        return samples;
+    }
+    return (samples * ticksPerSampleNum + ticksPerSampleDen / 2) / ticksPerSampleDen;
+}
+
+void WaitCoalescer::WriteSamples(uint32_t samples) {
+    sampleTime += samples;
+    uint64_t target = ToTick(sampleTime);
+    uint32_t ticks = (uint32_t)(target - tickTime);
+    tickTime = target;
+    
+    if (ticksPerSampleNum != ticksPerSampleDen) {
+        uint64_t exact = sampleTime * ticksPerSampleNum;
+        uint64_t placed = tickTime * ticksPerSampleDen;
+        uint64_t error = exact > placed ? exact - placed : placed - exact;
+        if (error > maxErrorScaled) maxErrorScaled = error;
+    }
+    
+    if (deferOpening) {
+        deferOpening = false;
+        hasOpening = true;
+        openingTick = target;
+        return;
+    }
+    if (ticks == 0) {
+        return; // Lands on the tick already reached
+    }
+    writer.WriteWait(ticks);
+    writtenBytes += S98Writer::GetWaitSize(ticks);
+}
+
+void WaitCoalescer::AddWait(uint32_t samples) {
+    if (samples == 0) {
+        return;
+    }
+    
+    // Size this wait would have on its own: its ticks under the same
+    // absolute-time rounding, so a coarse timer's savings are not counted
+    separateSampleTime += samples;
+    uint64_t target = ToTick(separateSampleTime);
+    if (target > separateTickTime) {
+        separateBytes += S98Writer::GetWaitSize((uint32_t)(target - separateTickTime));
+        separateTickTime = target;
+    }
+    
+    if (!enabled) {
+        WriteSamples(samples);
+        return;
+    }
+    
+    // Keep the running total from wrapping on absurdly long silences
+    if (pending > 0xFFFFFFFF - samples) {
+        Flush();
+    }
+    pending += samples;
+}
+
+void WaitCoalescer::Flush() {
+    // A chunk's first flush marks where waits from earlier chunks end,
+    // even when this chunk has added none yet
+    if (pending == 0 && !deferOpening) {
+        return;
+    }
+    WriteSamples(pending);
+    pending = 0;
+}
@@ -0,0 +1,66 @@
+#ifndef WAIT_COALESCER_H
+#define WAIT_COALESCER_H
+
+#include <stdint.h>
+#include "s98_writer.h"
+
+// Sits between the VGM command loop and S98Writer and merges runs of
+// consecutive waits into a single S98 sync. Anything that must land at an
+// exact position in the stream (a register write, the loop point, the end
+// marker) has to call Flush() first.
+//
+// Waits arrive in 44100 Hz samples and leave in S98 timer ticks. With a
+// coarser timer each flush goes to the tick nearest the absolute sample
+// time reached so far, so rounding never accumulates into drift.
+class WaitCoalescer {
+public:
+    WaitCoalescer(S98Writer& writer, bool enabled = true);
+    
+    // One tick lasts numerator/denominator seconds (see S98Writer::SetTimer)
+    void SetTimer(uint32_t numerator, uint32_t denominator);
+    
+    void AddWait(uint32_t samples);
+    void Flush();
+    
+    // Encode one piece of a stream that is split into chunks: continue at
+    // sample time startSamples, as if everything before had been written.
+    // With coalescing the first flush writes nothing, since its wait
+    // reaches back into earlier chunks; JoinChunk writes it.
+    void StartChunk(uint64_t startSamples);
+    
+    // Before appending a chunk's output to this coalescer's writer: write
+    // the wait that spans the boundary and carry on from the chunk's end
+    void JoinChunk(const WaitCoalescer& chunk);
+    
+    // Sync bytes avoided compared to writing every wait on its own at the
+    // same timer (what --no-coalesce writes)
+    uint32_t GetBytesSaved() const { return separateBytes - writtenBytes; }
+    
+    // Largest distance between an event's VGM time and its tick, in samples
+    double GetMaxError() const { return (double)maxErrorScaled / ticksPerSampleNum; }
+    
+private:
+    S98Writer& writer;
+    bool enabled;
+    uint32_t pending;       // Samples accumulated since the last flush
+    uint32_t separateBytes; // Bytes the waits would take one by one
+    uint32_t writtenBytes;  // Bytes actually written for them
+    uint64_t separateSampleTime; // Clock of the one-by-one waits, so they
+    uint64_t separateTickTime;   // are rounded the way they would be written
+    
+    // ticks = samples * ticksPerSampleNum / ticksPerSampleDen
+    uint64_t ticksPerSampleNum;
+    uint64_t ticksPerSampleDen;
+    uint64_t sampleTime;     // Samples flushed so far
+    uint64_t tickTime;       // Ticks written so far
+    uint64_t maxErrorScaled; // Max error in samples, times ticksPerSampleNum
+    
+    bool deferOpening;    // The next flush is a chunk's opening wait
+    bool hasOpening;
+    uint64_t openingTick;
+    
+    uint64_t ToTick(uint64_t samples) const;
+    void WriteSamples(uint32_t samples);
+};
+
+#endif // WAIT_COALESCER_H
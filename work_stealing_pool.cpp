@@ -0,0 +1,81 @@
+#include "work_stealing_pool.h"
+#include <system_error>
+#include <thread>
+
+WorkStealingPool::WorkStealingPool(unsigned threads) : threadCount(threads) {
+    if (threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    if (threadCount == 0) {
+        threadCount = 1;
+    }
+}
+
+void WorkStealingPool::Run(size_t taskCount, const std::function<void(size_t, unsigned)>& task) {
+    if (taskCount == 0) {
+        return;
+    }
+    
+    unsigned workers = threadCount;
+    if (workers > taskCount) {
+        workers = (unsigned)taskCount;
+    }
+    
+    // Seed each worker with a contiguous range so neighbouring tasks stay
+    // on one thread until stealing kicks in
+    queues = std::vector<WorkQueue>(workers);
+    for (size_t i = 0; i < taskCount; i++) {
+        queues[(i * workers) / taskCount].tasks.push_back(i);
+    }
+    
+    // A worker whose thread cannot be started leaves its queue to be
+    // stolen by the others
+    std::vector<std::thread> threads;
+    for (unsigned w = 1; w < workers; w++) {
+        try {
+            threads.push_back(std::thread(&WorkStealingPool::WorkerLoop, this, w, std::cref(task)));
+        } catch (const std::system_error&) {
+            break;
+        }
+    }
+    WorkerLoop(0, task);
+    
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    queues.clear();
+}
+
+bool WorkStealingPool::PopLocal(unsigned workerId, size_t& index) {
+    WorkQueue& queue = queues[workerId];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    index = queue.tasks.front();
+    queue.tasks.pop_front();
+    return true;
+}
+
+bool WorkStealingPool::Steal(unsigned workerId, size_t& index) {
+    // Visit victims starting after ourselves to spread contention
+    size_t count = queues.size();
+    for (size_t i = 1; i < count; i++) {
+        WorkQueue& victim = queues[(workerId + i) % count];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            index = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::WorkerLoop(unsigned workerId, const std::function<void(size_t, unsigned)>& task) {
+    // No tasks are added after Run starts, so an empty sweep means done
+    size_t index;
+    while (PopLocal(workerId, index) || Steal(workerId, index)) {
+        task(index, workerId);
+    }
+}
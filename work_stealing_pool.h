@@ -0,0 +1,39 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <stddef.h>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Runs a fixed set of indexed tasks across worker threads. Each worker
+// drains its own deque from the front and, once empty, steals from the
+// back of the other workers' deques, so long tasks on one worker do not
+// leave the rest idle.
+class WorkStealingPool {
+public:
+    // threadCount = 0 picks the hardware concurrency
+    explicit WorkStealingPool(unsigned threadCount = 0);
+    
+    unsigned GetThreadCount() const { return threadCount; }
+    
+    // Call task(index, workerId) once for every index in [0, taskCount).
+    // Returns when all tasks have finished.
+    void Run(size_t taskCount, const std::function<void(size_t, unsigned)>& task);
+    
+private:
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+    
+    unsigned threadCount;
+    std::vector<WorkQueue> queues;
+    
+    bool PopLocal(unsigned workerId, size_t& index);
+    bool Steal(unsigned workerId, size_t& index);
+    void WorkerLoop(unsigned workerId, const std::function<void(size_t, unsigned)>& task);
+};
+
+#endif // WORK_STEALING_POOL_H